@@ -0,0 +1,205 @@
+#ifndef BIASED_REFCOUNT_HPP
+#define BIASED_REFCOUNT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+#include <godot_cpp/core/memory.hpp>
+#include <godot_cpp/core/safe_refcount.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#include "macros.hpp"
+
+namespace gdrblx {
+
+namespace internal {
+
+class BiasedRefCount;
+
+// Per thread record of the objects whose biased counts that thread owns.
+// Decrements other threads could not apply are queued here and applied by the owner
+// on its next own decrement or in process_current(), or by the releasing thread itself
+// once the owner exited.
+class BiasedRefOwner final {
+    friend class BiasedRefCount;
+
+    struct Pending {
+        BiasedRefCount *rc;
+        void *object;
+        void (*destroy)(void*);
+    };
+    struct Handle {
+        BiasedRefOwner *owner = nullptr;
+        ~Handle() {
+            if (owner != nullptr)
+                owner->exit();
+        }
+    };
+
+    // Trivial so the hot path is a single TLS load, the Handle is only touched on creation.
+    static inline thread_local BiasedRefOwner *tls_current = nullptr;
+
+    ::godot::SafeRefCount refs; // the thread and every object it owns.
+    std::mutex lock;
+    ::godot::LocalVector<Pending> pending;
+    std::atomic<bool> has_pending = false;
+    bool dead = false;
+
+    BiasedRefOwner() {
+        refs.init();
+    }
+    GDRBLX_INLINE void release() {
+        if (refs.unref())
+            ::godot::memdelete(this);
+    }
+    void enqueue(const Pending& p_pending);
+    void exit();
+    void process_pending();
+    static BiasedRefOwner* create_current() {
+        thread_local Handle handle;
+        if (handle.owner == nullptr)
+            handle.owner = memnew(BiasedRefOwner);
+        tls_current = handle.owner;
+        return handle.owner;
+    }
+public:
+    GDRBLX_INLINE static BiasedRefOwner* current() {
+        BiasedRefOwner *self = tls_current;
+        if (unlikely(self == nullptr))
+            return create_current();
+        return self;
+    }
+    // Applies the decrements queued for objects created on this thread.
+    static void process_current();
+}; // class BiasedRefOwner
+
+// Biased reference count: the creating thread counts with plain integers,
+// every other thread goes through the shared atomic counter.
+// Once the owner's count drops to zero the counts are merged and only the atomic one is used.
+// The shared counter never goes below zero before merging, a decrement that would
+// is handed to the owner thread instead, whose biased count still covers that reference.
+class BiasedRefCount final {
+    friend class BiasedRefOwner;
+    static constexpr int64_t MERGED = int64_t(1) << 62;
+
+    BiasedRefOwner *owner = nullptr;
+    uint32_t biased = 0;
+    bool merged = false; // only touched by the owner, or under its lock after it exited.
+    std::atomic<int64_t> shared = 0;
+
+    GDRBLX_INLINE bool is_owner(const BiasedRefOwner *p_self) const {
+        return owner == p_self && !merged;
+    }
+    GDRBLX_INLINE bool unref_biased() {
+        if (--biased > 0)
+            return false;
+        merged = true;
+        return shared.fetch_or(MERGED, std::memory_order_acq_rel) == 0;
+    }
+    bool unref_shared(void *p_object, void (*p_destroy)(void*)) {
+        int64_t old = shared.load(std::memory_order_relaxed);
+        while (true) {
+            if (!(old & MERGED) && old == 0) {
+                owner->enqueue({ this, p_object, p_destroy });
+                return false;
+            }
+            if (shared.compare_exchange_weak(old, old - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return old == (MERGED | 1);
+        }
+    }
+public:
+    BiasedRefCount() {}
+    BiasedRefCount(const BiasedRefCount&) = delete;
+    BiasedRefCount& operator=(const BiasedRefCount&) = delete;
+    GDRBLX_INLINE ~BiasedRefCount() {
+        if (owner != nullptr)
+            owner->release();
+    }
+
+    GDRBLX_INLINE void init() {
+        owner = BiasedRefOwner::current();
+        owner->refs.ref();
+        biased = 1;
+        merged = false;
+        shared.store(0, std::memory_order_relaxed);
+    }
+    GDRBLX_INLINE void ref() {
+        if (is_owner(BiasedRefOwner::current()))
+            biased++;
+        else
+            shared.fetch_add(1, std::memory_order_relaxed);
+    }
+    // True when the caller has to destroy the object now.
+    // p_destroy is used when the last reference ends up released by the owner thread later.
+    // The owner also applies what other threads queued for it, after its own decrement:
+    // a queued one is still covered by the biased count, so this object cannot be in the queue
+    // when it is the one being destroyed.
+    GDRBLX_INLINE bool unref(void *p_object, void (*p_destroy)(void*)) {
+        BiasedRefOwner *self = BiasedRefOwner::current();
+        if (!is_owner(self))
+            return unref_shared(p_object, p_destroy);
+        const bool destroy = unref_biased();
+        if (unlikely(self->has_pending.load(std::memory_order_relaxed)))
+            self->process_pending();
+        return destroy;
+    }
+}; // class BiasedRefCount
+
+inline void BiasedRefOwner::enqueue(const Pending& p_pending) {
+    lock.lock();
+    if (!dead) {
+        pending.push_back(p_pending);
+        has_pending.store(true, std::memory_order_release);
+        lock.unlock();
+        return;
+    }
+    // nobody will drain the queue anymore, apply it here.
+    refs.ref(); // destroying the object may drop the last other reference to this record.
+    bool destroy = p_pending.rc->unref_biased();
+    lock.unlock();
+    if (destroy)
+        p_pending.destroy(p_pending.object);
+    release();
+}
+
+inline void BiasedRefOwner::exit() {
+    ::godot::LocalVector<Pending> destroyed;
+    lock.lock();
+    dead = true;
+    for (const Pending& p : pending) {
+        if (p.rc->unref_biased())
+            destroyed.push_back(p);
+    }
+    pending.clear();
+    lock.unlock();
+    for (const Pending& p : destroyed)
+        p.destroy(p.object);
+    release();
+}
+
+// Destroying an object may release others and re-enter, the batch is taken out first.
+inline void BiasedRefOwner::process_pending() {
+    ::godot::LocalVector<Pending> batch;
+    lock.lock();
+    std::swap(batch, pending);
+    has_pending.store(false, std::memory_order_relaxed);
+    lock.unlock();
+    for (const Pending& p : batch) {
+        if (p.rc->unref_biased())
+            p.destroy(p.object);
+    }
+}
+
+inline void BiasedRefOwner::process_current() {
+    BiasedRefOwner *self = current();
+    if (self->has_pending.load(std::memory_order_acquire))
+        self->process_pending();
+}
+
+} // namespace internal
+
+} // namespace gdrblx
+
+#endif // BIASED_REFCOUNT_HPP
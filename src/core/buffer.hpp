@@ -3,34 +3,154 @@
 
 #include <cstddef>
 #include <cstring>
+#include <new>
 
 #include <godot_cpp/core/error_macros.hpp>
 #include <godot_cpp/core/math.hpp>
+#include <godot_cpp/core/memory.hpp>
+#include <godot_cpp/core/safe_refcount.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
 
 #include "macros.hpp"
 #include "string.hpp"
 
 namespace gdrblx {
 
+namespace internal {
+
+// Refcounted bytes of a LuaBuffer, followed by 8 bytes of zero padding.
+// An aliasing block holds a PackedByteArray instead and has no padding of its own.
+struct alignas(16) LuaBufferData {
+    ::godot::SafeRefCount ref_count;
+    bool aliased = false; // bytes belong to `array`, never written in place.
+    ::godot::PackedByteArray array;
+
+    GDRBLX_INLINE uint8_t *bytes() {
+        return aliased ? (uint8_t*)array.ptr() : (uint8_t*)(this + 1);
+    }
+    GDRBLX_INLINE static LuaBufferData* create(size_t p_size) {
+        LuaBufferData *d = new (memalloc(sizeof(LuaBufferData) + p_size + 8)) LuaBufferData;
+        d->ref_count.init();
+        return d;
+    }
+    GDRBLX_INLINE static LuaBufferData* create_alias(const ::godot::PackedByteArray& p_array) {
+        LuaBufferData *d = new (memalloc(sizeof(LuaBufferData))) LuaBufferData;
+        d->ref_count.init();
+        d->aliased = true;
+        d->array = p_array;
+        return d;
+    }
+    GDRBLX_INLINE void incref() {
+        ref_count.ref();
+    }
+    GDRBLX_INLINE void decref() {
+        if (ref_count.unref()) {
+            this->~LuaBufferData();
+            memfree(this);
+        }
+    }
+};
+
+} // namespace internal
+
+// Copies share the bytes and copy them on the first write, so passing
+// a buffer between states or Actors does not copy its contents.
 class LuaBuffer {
+    internal::LuaBufferData *shared = nullptr;
     uint8_t *data = nullptr;
     size_t size = 0;
+
+    GDRBLX_INLINE void release() {
+        if (shared != nullptr)
+            shared->decref();
+    }
+    // Reads past the end see zeros, the padding of owned bytes. Aliased bytes have none,
+    // so those reads are assembled from what is left instead.
+    template <typename T>
+    GDRBLX_INLINE T read(size_t p_offset) const {
+        DEV_ASSERT(p_offset < size);
+        T value;
+        if (likely(size >= sizeof(T) && p_offset <= size - sizeof(T))) {
+            memcpy(&value, data + p_offset, sizeof(T));
+            return value;
+        }
+        uint8_t bytes[sizeof(T)] = {};
+        if (p_offset < size)
+            memcpy(bytes, data + p_offset, size - p_offset);
+        memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+    GDRBLX_INLINE void make_unique() {
+        if (shared == nullptr || (shared->ref_count.get() == 1 && !shared->aliased))
+            return;
+        internal::LuaBufferData *d = internal::LuaBufferData::create(size);
+        memcpy(d->bytes(), data, size);
+        memset(d->bytes() + size, 0, 8);
+        shared->decref();
+        shared = d;
+        data = d->bytes();
+    }
 public:
     GDRBLX_INLINE LuaBuffer() {}
-    GDRBLX_INLINE LuaBuffer(size_t p_size) : size(p_size) {
-        data = (uint8_t*)memalloc(p_size+8);
+    GDRBLX_INLINE LuaBuffer(size_t p_size) : shared(internal::LuaBufferData::create(p_size)), size(p_size) {
+        data = shared->bytes();
         memset(data, 0, p_size+8);
     }
-    GDRBLX_INLINE LuaBuffer(const LuaBuffer& p_buf) : size(p_buf.size) {
-        data = (uint8_t*)memalloc(size+8);
-        memcpy(data, p_buf.data, p_buf.size+8);
+    GDRBLX_INLINE LuaBuffer(const LuaBuffer& p_buf) : shared(p_buf.shared), data(p_buf.data), size(p_buf.size) {
+        if (shared != nullptr)
+            shared->incref();
+    }
+    GDRBLX_INLINE LuaBuffer(LuaBuffer&& p_buf) : shared(p_buf.shared), data(p_buf.data), size(p_buf.size) {
+        p_buf.shared = nullptr;
+        p_buf.data = nullptr;
+        p_buf.size = 0;
     }
     GDRBLX_INLINE ~LuaBuffer() {
-        memfree(data);
+        release();
+    }
+    GDRBLX_INLINE LuaBuffer& operator=(const LuaBuffer& p_buf) {
+        if (p_buf.shared != nullptr)
+            p_buf.shared->incref();
+        release();
+        shared = p_buf.shared;
+        data = p_buf.data;
+        size = p_buf.size;
+        return *this;
+    }
+    GDRBLX_INLINE LuaBuffer& operator=(LuaBuffer&& p_buf) {
+        if (this == &p_buf)
+            return *this;
+        release();
+        shared = p_buf.shared;
+        data = p_buf.data;
+        size = p_buf.size;
+        p_buf.shared = nullptr;
+        p_buf.data = nullptr;
+        p_buf.size = 0;
+        return *this;
     }
 
-    GDRBLX_INLINE LuaBuffer(const LuaString& p_str) : size(p_str.l) {
-        data = (uint8_t*)memalloc(size+8);
+    // Reads the array's bytes in place, they are copied on the first write.
+    // Aliased bytes have no zero padding past the end, read() makes up for it.
+    GDRBLX_INLINE LuaBuffer(const ::godot::PackedByteArray& p_array) : size(p_array.size()) {
+        if (size == 0)
+            return;
+        shared = internal::LuaBufferData::create_alias(p_array);
+        data = shared->bytes();
+    }
+    // Returns the aliased array as is when the buffer was never written to.
+    GDRBLX_INLINE ::godot::PackedByteArray to_packed_byte_array() const {
+        if (shared != nullptr && shared->aliased)
+            return shared->array;
+        ::godot::PackedByteArray array;
+        array.resize(size);
+        if (size > 0)
+            memcpy(array.ptrw(), data, size);
+        return array;
+    }
+
+    GDRBLX_INLINE LuaBuffer(const LuaString& p_str) : shared(internal::LuaBufferData::create(p_str.l)), size(p_str.l) {
+        data = shared->bytes();
         memcpy(data, p_str.s, size);
         memset(data+size, 0, 8);
     }
@@ -41,83 +161,83 @@ public:
     GDRBLX_INLINE size_t len() const { return size; }
 
     GDRBLX_INLINE int8_t readi8(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(int8_t*)(data+p_offset);
+        return read<int8_t>(p_offset);
     }
     GDRBLX_INLINE uint8_t readu8(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(data+p_offset);
+        return read<uint8_t>(p_offset);
     }
     GDRBLX_INLINE int16_t readi16(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(int16_t*)(data+p_offset);
+        return read<int16_t>(p_offset);
     }
     GDRBLX_INLINE uint16_t readu16(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(uint16_t*)(data+p_offset);
+        return read<uint16_t>(p_offset);
     }
     GDRBLX_INLINE int32_t readi32(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(int32_t*)(data+p_offset);
+        return read<int32_t>(p_offset);
     }
     GDRBLX_INLINE uint32_t readu32(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(uint32_t*)(data+p_offset);
+        return read<uint32_t>(p_offset);
     }
     GDRBLX_INLINE int64_t readi64(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(int64_t*)(data+p_offset);
+        return read<int64_t>(p_offset);
     }
     GDRBLX_INLINE uint64_t readu64(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(uint64_t*)(data+p_offset);
+        return read<uint64_t>(p_offset);
     }
     GDRBLX_INLINE float readf32(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(float*)(data+p_offset);
+        return read<float>(p_offset);
     }
     GDRBLX_INLINE double readf64(size_t p_offset) const {
-        DEV_ASSERT(p_offset < size);
-        return *(double*)(data+p_offset);
+        return read<double>(p_offset);
     }
 
     GDRBLX_INLINE void writei8(size_t p_offset, int8_t p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(int8_t*)(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writeu8(size_t p_offset, uint8_t p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writei16(size_t p_offset, int16_t p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(int16_t*)(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writeu16(size_t p_offset, uint16_t p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(uint16_t*)(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writei32(size_t p_offset, int32_t p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(int32_t*)(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writeu32(size_t p_offset, uint32_t p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(uint32_t*)(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writei64(size_t p_offset, int64_t p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(int64_t*)(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writeu64(size_t p_offset, uint64_t p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(uint64_t*)(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writef32(size_t p_offset, float p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(float*)(data+p_offset) = p_val;
     }
     GDRBLX_INLINE void writef64(size_t p_offset, double p_val) {
+        make_unique();
         DEV_ASSERT(p_offset < size);
         *(double*)(data+p_offset) = p_val;
     }
@@ -129,12 +249,14 @@ public:
         return LuaString(data+p_offset,str_size);
     }
     GDRBLX_INLINE void writestring(size_t p_offset, const LuaString& p_string) {
-        size_t str_size = MAX(0,MIN(p_length,(int64_t)size-p_offset-p_string.l));
+        make_unique();
+        size_t str_size = MAX(0,MIN((int64_t)p_string.l,(int64_t)size-p_offset));
         if (str_size == 0)
             return;
         memcpy(data+p_offset,p_string.s,str_size);
     }
     GDRBLX_INLINE void writestring(size_t p_offset, const LuaString& p_string, size_t p_count) {
+        make_unique();
         DEV_ASSERT(p_string.l >= p_count);
         size_t str_size = MAX(0,MIN(MIN(p_count,p_string.l),(int64_t)size-p_offset));
         if (str_size == 0)
@@ -142,28 +264,32 @@ public:
         memcpy(data+p_offset,p_string.s,str_size);
     }
     GDRBLX_INLINE void copy(size_t p_dest_offset, const LuaBuffer& p_src, size_t p_src_offset = 0) {
+        make_unique();
         size_t buf_size = MAX(0, MIN((int64_t)size-p_dest_offset,(int64_t)p_src.size-p_src_offset));
         if (buf_size == 0)
             return;
         memcpy(data+p_dest_offset,p_src.data+p_src_offset,buf_size);
     }
     GDRBLX_INLINE void copy(size_t p_dest_offset, const LuaBuffer& p_src, size_t p_src_offset, size_t p_count) {
+        make_unique();
         size_t buf_size = MAX(0, MIN(MIN((int64_t)size-p_dest_offset,(int64_t)p_src.size-p_src_offset),p_count));
         if (buf_size == 0)
             return;
         memcpy(data+p_dest_offset,p_src.data+p_src_offset,buf_size);
     }
     GDRBLX_INLINE void fill(size_t p_offset, uint8_t p_value) {
+        make_unique();
         size_t buf_size = MAX(0,(int64_t)size-p_offset);
         if (buf_size == 0)
             return;
-        memset(data, p_value, buf_size);
+        memset(data+p_offset, p_value, buf_size);
     }
     GDRBLX_INLINE void fill(size_t p_offset, uint8_t p_value, size_t p_count) {
+        make_unique();
         size_t buf_size = MAX(0,MIN(p_count,(int64_t)size-p_offset));
         if (buf_size == 0)
             return;
-        memset(data, p_value, buf_size);
+        memset(data+p_offset, p_value, buf_size);
     }
 };
 
@@ -1,6 +1,8 @@
 #ifndef CONTEXT_HPP
 #define CONTEXT_HPP
 
+#include <type_traits>
+
 #include <lua.h>
 #include <luacode.h>
 
@@ -14,12 +16,37 @@
 #include "function.hpp"
 #include "userdata.hpp"
 #include "lua_tuple.hpp"
+#include "format.hpp"
+#include "stack_view.hpp"
+#include "native_coroutine.hpp"
 
 namespace gdrblx {
 
+class LuauCtx;
+
+namespace internal {
+
+// Returned by LuauCtx::wait, `return ctx.wait(t);` from a C function or `co_await ctx.wait(t)` from a LuaNativeTask.
+class LuaWaitAwaiter final {
+    const LuauCtx *ctx;
+    double duration;
+    LuaNativeTask::Handle handle;
+public:
+    GDRBLX_INLINE LuaWaitAwaiter(const LuauCtx *p_ctx, double p_duration) : ctx(p_ctx), duration(p_duration) {}
+
+    operator int() const;
+
+    GDRBLX_INLINE bool await_ready() const { return false; }
+    void await_suspend(LuaNativeTask::Handle p_handle);
+    double await_resume() const;
+};
+
+} // namespace internal
+
 class LuauCtx {
     friend class LuaObject;
     friend class TaskScheduler;
+    friend class internal::LuaWaitAwaiter;
 
     LuauState *const pv_state;
 protected:
@@ -50,12 +77,7 @@ protected:
         return *pv_state->get_scheduler();
     }
 public:
-    GDRBLX_INLINE LuauCtx(lua_State *p_L) : L(p_L), pv_state(([](lua_State *p_L) {
-        lua_getfield(p_L, LUA_REGISTRYINDEX, "luau_state");
-        LuauState* state = (LuauState*)lua_tolightuserdata(p_L, -1);
-        lua_pop(p_L, 1);
-        return state;
-    })(p_L)) {
+    GDRBLX_INLINE LuauCtx(lua_State *p_L) : L(p_L), pv_state(LuauState::from_lua_state(p_L)) {
         last_stack_size = get_stack_size();
     }
     ~LuauCtx() {
@@ -67,24 +89,32 @@ protected:
     GDRBLX_INLINE LuaObject as_local(size_t stack_pos) const {
         return LuaObject(L, stack_pos);
     }
-    template <typename T, typename... Args>
-    GDRBLX_INLINE size_t push_objects(T p_obj, Args... p_args) const {
+    // Tuples and stack views expand in place, anywhere in the argument list.
+    template <typename T, typename... Args> requires (!std::is_same_v<T, LuaTuple> && !std::is_base_of_v<LuaStackView, T>)
+    GDRBLX_INLINE size_t push_objects(const T& p_obj, const Args&... p_args) const {
         ((LuaObject)p_obj).push_to_stack(pv_state, L);
         return 1 + push_objects(p_args...);
     }
-    template <typename T>
-    GDRBLX_INLINE size_t push_objects(T p_obj) const {
-        ((LuaObject)p_obj).push_to_stack(pv_state, L);
-        return 1;
-    }
     GDRBLX_INLINE size_t push_objects() const {
         return 0;
     }
-    GDRBLX_INLINE size_t push_objects(const LuaTuple& p_tuple) const {
+    template <typename... Args>
+    GDRBLX_INLINE size_t push_objects(const LuaTuple& p_tuple, const Args&... p_args) const {
         for (int i = 1; i <= p_tuple.get_size(); i++) {
             p_tuple[i].push_to_stack(pv_state, L);
         }
-        return p_tuple.get_size();
+        return p_tuple.get_size() + push_objects(p_args...);
+    }
+    template <typename... Args>
+    GDRBLX_INLINE size_t push_objects(const LuaStackView& p_view, const Args&... p_args) const {
+        lua_checkstack(L, p_view.size());
+        for (int i = 0; i < p_view.size(); i++) {
+            if (p_view.L == L)
+                lua_pushvalue(L, p_view.base + i);
+            else
+                lua_xpush(p_view.L, L, p_view.base + i);
+        }
+        return p_view.size() + push_objects(p_args...);
     }
 
     GDRBLX_INLINE LuaObject get_globals() const {
@@ -162,10 +192,8 @@ public:
         size_t args_pushed = push_objects(p_args);
         return lua_yield(L, args_pushed);
     }
-    GDRBLX_INLINE auto wait(double p_duration) const {
-        push_objects(LuaFunction(get_scheduler().lua_wait,"TaskScheduler::wait"), p_duration);
-        lua_call(L, 1, 1);
-        return LUA_YIELD;
+    GDRBLX_INLINE internal::LuaWaitAwaiter wait(double p_duration) const {
+        return internal::LuaWaitAwaiter(this, p_duration);
     }
     GDRBLX_INLINE [[noreturn]] void terminate() const {
         push_objects(get_scheduler().lua_terminate);
@@ -181,7 +209,7 @@ public:
             if (t != LuaObject::THREAD)
                 errorf("resume(): expected type thread, got %s", LuaObject::static_get_typename(t));
         }
-        lua_State *thr = lua_tothread(L, thread.local_stack_pos);
+        lua_State *thr = lua_tothread(L, thread.local_stack_pos());
         LuauCtx ctx = thr;
         int nargs,nres;
         nargs = ctx.push_objects(p_args...);
@@ -201,14 +229,12 @@ public:
             if (t != LuaObject::THREAD)
                 errorf("resume(): expected type thread, got %s", LuaObject::static_get_typename(t));
         }
-        lua_State *thr = lua_tothread(L, thread.local_stack_pos);
+        lua_State *thr = lua_tothread(L, thread.local_stack_pos());
         LuauCtx ctx = thr;
-        int nargs,nres;
-        nargs = ctx.push_objects(p_args...);
-        nres = lua_resume(thr, L, nargs);
-        Vec<LuaObject> vec;
-        for (int i = 1; i <= nres; i++)
-            vec.push_back(LuaObject::convert(thr, -nres));
+        int status = lua_resume(thr, L, ctx.push_objects(p_args...));
+        int nres = (status == LUA_OK || status == LUA_YIELD) ? lua_gettop(thr) : 1;
+        Vec<LuaObject> vec = LuaObject::convert_range(thr, -nres, nres);
+        lua_pop(thr, nres);
         return std::move(vec);
     }
     LuaObject resume(const LuaThread& p_thread, LuaTuple p_args) const {
@@ -218,7 +244,7 @@ public:
             if (t != LuaObject::THREAD)
                 errorf("resume(): expected type thread, got %s", LuaObject::static_get_typename(t));
         }
-        lua_State *thr = lua_tothread(L, thread.local_stack_pos);
+        lua_State *thr = lua_tothread(L, thread.local_stack_pos());
         LuauCtx ctx = thr;
         int nargs,nres;
         nargs = ctx.push_objects(p_args);
@@ -238,14 +264,12 @@ public:
             if (t != LuaObject::THREAD)
                 errorf("resume(): expected type thread, got %s", LuaObject::static_get_typename(t));
         }
-        lua_State *thr = lua_tothread(L, thread.local_stack_pos);
+        lua_State *thr = lua_tothread(L, thread.local_stack_pos());
         LuauCtx ctx = thr;
-        int nargs,nres;
-        nargs = ctx.push_objects(p_args);
-        nres = lua_resume(thr, L, nargs);
-        Vec<LuaObject> vec;
-        for (int i = 1; i <= nres; i++)
-            vec.push_back(LuaObject::convert(thr, -nres));
+        int status = lua_resume(thr, L, ctx.push_objects(p_args));
+        int nres = (status == LUA_OK || status == LUA_YIELD) ? lua_gettop(thr) : 1;
+        Vec<LuaObject> vec = LuaObject::convert_range(thr, -nres, nres);
+        lua_pop(thr, nres);
         return std::move(vec);
     }
 
@@ -275,28 +299,22 @@ public:
             lua_error(L);
         }
         lua_call(L, push_objects(p_args...), nres);
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         return std::move(vec);
     }
     template <typename... Args>
     GDRBLX_INLINE LuaTuple call_v(const LuaFunction& p_func, Args... p_args) const {
         DEV_ASSERT(p_func.valid());
-        size_t stack_size = get_stack_size();
+        const int top = lua_gettop(L); // results land above it.
         push_function(pv_state, L, p_func);
         if (lua_type(L, -1) == LUA_TNIL) {
             lua_pushstring(L, "cannot call nil value.");
             lua_error(L);
         }
         lua_call(L, push_objects(p_args...), LUA_MULTRET);
-        size_t nres = get_stack_size()-nres;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        size_t nres = lua_gettop(L) - top;
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         return std::move(vec);
     }
@@ -320,27 +338,21 @@ public:
             lua_error(L);
         }
         lua_call(L, push_objects(p_args), nres);
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         return std::move(vec);
     }
     GDRBLX_INLINE LuaTuple call_v(const LuaFunction& p_func, LuaTuple p_args) const {
         DEV_ASSERT(p_func.valid());
-        size_t stack_size = get_stack_size();
+        const int top = lua_gettop(L); // results land above it.
         push_function(pv_state, L, p_func);
         if (lua_type(L, -1) == LUA_TNIL) {
             lua_pushstring(L, "cannot call nil value.");
             lua_error(L);
         }
         lua_call(L, push_objects(p_args), LUA_MULTRET);
-        size_t nres = get_stack_size()-nres;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        size_t nres = lua_gettop(L) - top;
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         return std::move(vec);
     }
@@ -383,10 +395,7 @@ public:
         int status = lua_pcall(L, push_objects(p_args...), nres, 0);
         if (status == LUA_ERRMEM) pv_state->raise_oom_error();
         bool success = status == LUA_OK;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         if (success) 
             return Result<LuaTuple, LuaObject>::create_result(std::move(vec));
@@ -396,7 +405,7 @@ public:
     template <typename... Args>
     GDRBLX_INLINE Result<LuaTuple, LuaObject> pcall_v(const LuaFunction& p_func, Args... p_args) const {
         DEV_ASSERT(p_func.valid());
-        size_t stack_size = get_stack_size();
+        const int top = lua_gettop(L); // results land above it.
         push_function(pv_state, L, p_func);
         if (lua_type(L, -1) == LUA_TNIL) {
             lua_pushstring(L, "cannot call nil value.");
@@ -404,12 +413,9 @@ public:
         }
         int status = lua_pcall(L, push_objects(p_args...), LUA_MULTRET, 0);
         if (status == LUA_ERRMEM) pv_state->raise_oom_error();
-        size_t nres = get_stack_size()-nres;
+        size_t nres = lua_gettop(L) - top;
         bool success = status == LUA_OK;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         if (success) 
             return Result<LuaTuple, LuaObject>::create_result(std::move(vec));
@@ -461,10 +467,7 @@ public:
         lua_remove(L, errh_pos);
         if (status == LUA_ERRMEM) pv_state->raise_oom_error();
         bool success = status == LUA_OK;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         if (success) 
             return Result<LuaTuple, LuaObject>::create_result(std::move(vec));
@@ -475,13 +478,13 @@ public:
     GDRBLX_INLINE Result<LuaTuple, LuaObject> xpcall_v(const LuaFunction& p_func, const LuaFunction& p_errh, Args... p_args) const {
         DEV_ASSERT(p_func.valid());
         DEV_ASSERT(p_errh.valid());
+        const int top = lua_gettop(L); // results land above it once the handler is removed.
         push_function(pv_state, L, p_errh);
         if (lua_type(L, -1) == LUA_TNIL) {
             lua_pushstring(L, "cannot call nil value.");
             lua_error(L);
         }
         size_t errh_pos = lua_gettop(L);
-        size_t stack_size = errh_pos;
         push_function(pv_state, L, p_func);
         if (lua_type(L, -1) == LUA_TNIL) {
             lua_pushstring(L, "cannot call nil value.");
@@ -490,12 +493,9 @@ public:
         int status = lua_pcall(L, push_objects(p_args...), LUA_MULTRET, errh_pos);
         lua_remove(L, errh_pos);
         if (status == LUA_ERRMEM) pv_state->raise_oom_error();
-        size_t nres = get_stack_size()-nres;
+        size_t nres = lua_gettop(L) - top;
         bool success = status == LUA_OK;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         if (success) 
             return Result<LuaTuple, LuaObject>::create_result(std::move(vec));
@@ -529,10 +529,7 @@ public:
         int status = lua_pcall(L, push_objects(p_args), nres, 0);
         if (status == LUA_ERRMEM) pv_state->raise_oom_error();
         bool success = status == LUA_OK;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         if (success) 
             return Result<LuaTuple, LuaObject>::create_result(std::move(vec));
@@ -541,7 +538,7 @@ public:
     }
     GDRBLX_INLINE Result<LuaTuple, LuaObject> pcall_v(const LuaFunction& p_func, LuaTuple p_args) const {
         DEV_ASSERT(p_func.valid());
-        size_t stack_size = get_stack_size();
+        const int top = lua_gettop(L); // results land above it.
         push_function(pv_state, L, p_func);
         if (lua_type(L, -1) == LUA_TNIL) {
             lua_pushstring(L, "cannot call nil value.");
@@ -549,12 +546,9 @@ public:
         }
         int status = lua_pcall(L, push_objects(p_args), LUA_MULTRET, 0);
         if (status == LUA_ERRMEM) pv_state->raise_oom_error();
-        size_t nres = get_stack_size()-nres;
+        size_t nres = lua_gettop(L) - top;
         bool success = status == LUA_OK;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         if (success) 
             return Result<LuaTuple, LuaObject>::create_result(std::move(vec));
@@ -604,10 +598,7 @@ public:
         lua_remove(L, errh_pos);
         if (status == LUA_ERRMEM) pv_state->raise_oom_error();
         bool success = status == LUA_OK;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         if (success) 
             return Result<LuaTuple, LuaObject>::create_result(std::move(vec));
@@ -617,13 +608,13 @@ public:
     GDRBLX_INLINE Result<LuaTuple, LuaObject> xpcall_v(const LuaFunction& p_func, const LuaFunction& p_errh, LuaTuple p_args) const {
         DEV_ASSERT(p_func.valid());
         DEV_ASSERT(p_errh.valid());
+        const int top = lua_gettop(L); // results land above it once the handler is removed.
         push_function(pv_state, L, p_errh);
         if (lua_type(L, -1) == LUA_TNIL) {
             lua_pushstring(L, "cannot call nil value.");
             lua_error(L);
         }
         size_t errh_pos = lua_gettop(L);
-        size_t stack_size = errh_pos;
         push_function(pv_state, L, p_func);
         if (lua_type(L, -1) == LUA_TNIL) {
             lua_pushstring(L, "cannot call nil value.");
@@ -632,12 +623,9 @@ public:
         int status = lua_pcall(L, push_objects(p_args), LUA_MULTRET, errh_pos);
         lua_remove(L, errh_pos);
         if (status == LUA_ERRMEM) pv_state->raise_oom_error();
-        size_t nres = get_stack_size()-nres;
+        size_t nres = lua_gettop(L) - top;
         bool success = status == LUA_OK;
-        Vec<LuaObject> vec;
-        for (int i = 0; i < nres; i++) {
-            vec.push_back(LuaObject::convert(L, -nres+i));
-        }
+        Vec<LuaObject> vec = LuaObject::convert_range(L, -(int)nres, nres);
         lua_pop(L, nres);
         if (success) 
             return Result<LuaTuple, LuaObject>::create_result(std::move(vec));
@@ -645,14 +633,77 @@ public:
             return Result<LuaTuple, LuaObject>::create_error(std::move(vec)[0]);
     }
 
+    // Allocation free variants, arguments come from a variadic pack or a LuaStackView
+    // and the results stay on the stack behind a LuaStackResults.
+    template <typename... Args>
+    GDRBLX_INLINE LuaStackResults call_view(int nres, const LuaFunction& p_func, Args... p_args) const {
+        DEV_ASSERT(p_func.valid());
+        int base = lua_gettop(L);
+        push_function(pv_state, L, p_func);
+        if (lua_type(L, -1) == LUA_TNIL) {
+            lua_pushstring(L, "cannot call nil value.");
+            lua_error(L);
+        }
+        lua_call(L, push_objects(p_args...), nres);
+        return LuaStackResults(L, base + 1, lua_gettop(L) - base, LUA_OK);
+    }
+    template <typename... Args>
+    GDRBLX_INLINE LuaStackResults pcall_view(int nres, const LuaFunction& p_func, Args... p_args) const {
+        DEV_ASSERT(p_func.valid());
+        int base = lua_gettop(L);
+        push_function(pv_state, L, p_func);
+        if (lua_type(L, -1) == LUA_TNIL) {
+            lua_pushstring(L, "cannot call nil value.");
+            lua_error(L);
+        }
+        int status = lua_pcall(L, push_objects(p_args...), nres, 0);
+        if (status == LUA_ERRMEM) pv_state->raise_oom_error();
+        return LuaStackResults(L, base + 1, lua_gettop(L) - base, status);
+    }
+    template <typename... Args>
+    LuaStackResults resume_view(const LuaThread& p_thread, Args... p_args) const {
+        LuaObject thread = p_thread.native.as_local(L);
+        {
+            LuaObject::Type t = thread.get_type();
+            if (t != LuaObject::THREAD)
+                errorf("resume(): expected type thread, got %s", LuaObject::static_get_typename(t));
+        }
+        lua_State *thr = lua_tothread(L, thread.local_stack_pos());
+        LuauCtx ctx = thr;
+        ctx.dont_clear_stack();
+        int status = lua_resume(thr, L, ctx.push_objects(p_args...));
+        if (status != LUA_OK && status != LUA_YIELD)
+            return LuaStackResults(thr, lua_gettop(thr), 1, status);
+        return LuaStackResults(thr, 1, lua_gettop(thr), status);
+    }
+
     GDRBLX_INLINE [[noreturn]] void error(const LuaObject& p_err) const {
         push_objects(p_err);
         lua_error(L);
     }
+private:
+    // Formats natively when every argument is supported, otherwise goes through string.format.
+    // Leaves the resulting string on the top of the stack.
     template <typename... Args>
-    GDRBLX_INLINE LuaString stringf(const LuaString& p_str, Args... p_args) const {
+    GDRBLX_INLINE void push_formatted(const LuaString& p_str, Args... p_args) const {
+        if constexpr ((internal::LuaFormattable<Args> && ...)) {
+            const internal::LuaFormatArg args[sizeof...(Args) + 1] = {internal::LuaFormatArg(p_args)..., internal::LuaFormatArg(0)};
+            luaL_Strbuf buf;
+            luaL_buffinit(L, &buf);
+            if (internal::format_to_buffer(&buf, p_str.s, p_str.l, args, sizeof...(Args))) {
+                luaL_pushresult(&buf);
+                return;
+            }
+            luaL_pushresult(&buf);
+            lua_pop(L, 1); // let string.format raise the error
+        }
         push_objects(pv_state->get_stringf());
         lua_call(L, push_objects(p_str, p_args...), 1);
+    }
+public:
+    template <typename... Args>
+    GDRBLX_INLINE LuaString stringf(const LuaString& p_str, Args... p_args) const {
+        push_formatted(p_str, p_args...);
         size_t len;
         const char* str = lua_tolstring(L, -1, &len);
         LuaString s = LuaString(str, len);
@@ -661,9 +712,7 @@ public:
     }
     template <typename... Args>
     GDRBLX_INLINE [[noreturn]] void errorf(const LuaString& p_str, Args... p_args) const {
-        //error(stringf(p_str, p_args...));
-        push_objects(pv_state->get_stringf());
-        lua_call(L, push_objects(p_str, p_args...), 1);
+        push_formatted(p_str, p_args...);
         lua_error(L);
     }
 
@@ -692,13 +741,20 @@ public:
         return get_stack_size();
     }
     GDRBLX_INLINE LuaTuple get_args(int from = 1) const {
-        int size = get_args_count();
+        int count = get_args_count() - from + 1;
         Vec<LuaObject> vec;
-        for (int i = from; i <= size; i++) {
-            vec.push_back(get_arg(i));
-        }
+        if (count <= 0)
+            return std::move(vec);
+        vec.resize(count);
+        LuaObject *args = vec.ptrw();
+        for (int i = 0; i < count; i++)
+            new (&args[i]) LuaObject(L, from + i); // locals are trivial, nothing to release.
         return std::move(vec);
     }
+    GDRBLX_INLINE LuaStackView get_args_view(int from = 1) const {
+        int count = get_args_count() - from + 1;
+        return LuaStackView(L, from, count > 0 ? count : 0);
+    }
     GDRBLX_INLINE LuaObject expect(int p_arg_n, LuaObject::Type p_type) const {
         LuaObject expected = get_arg(p_arg_n);
         if (!expected.is_type(p_type)) {
@@ -769,6 +825,28 @@ public:
     }
 };
 
+namespace internal {
+
+inline LuaWaitAwaiter::operator int() const {
+    ctx->push_objects(LuaFunction(ctx->get_scheduler().lua_wait,"TaskScheduler::wait"), duration);
+    lua_call(ctx->L, 1, 1);
+    return LUA_YIELD;
+}
+
+inline void LuaWaitAwaiter::await_suspend(LuaNativeTask::Handle p_handle) {
+    handle = p_handle;
+    ctx->get_scheduler().delay(duration, (LuaThread)*ctx);
+}
+
+inline double LuaWaitAwaiter::await_resume() const {
+    LuaStackView args = handle.promise().get_resume_args();
+    if (!args.is_empty() && lua_isnumber(args.get_lua_state(), args.get_base()))
+        return lua_tonumber(args.get_lua_state(), args.get_base());
+    return duration;
+}
+
+} // namespace internal
+
 } // namespace gdrblx
 
 #endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+#ifndef EPOCH_HPP
+#define EPOCH_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+#include <godot_cpp/core/memory.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#include "macros.hpp"
+
+namespace gdrblx {
+
+namespace internal {
+
+// Epoch based reclamation for read-copy-update structures such as SharedTable.
+// Readers publish the epoch they entered in on their own cache line and never block.
+// Writers unlink data first and retire it, it is freed once every reader that could
+// still see it has left its read section.
+class EpochDomain final {
+    static constexpr uint64_t QUIESCENT = UINT64_MAX;
+
+    struct alignas(64) Participant {
+        std::atomic<uint64_t> epoch = QUIESCENT;
+        std::atomic<bool> in_use = true;
+        Participant *next = nullptr;
+        uint32_t depth = 0; // read sections nest, only touched by the owning thread.
+    };
+    struct Handle {
+        Participant *participant = nullptr;
+        ~Handle() {
+            if (participant == nullptr)
+                return;
+            participant->epoch.store(QUIESCENT, std::memory_order_release);
+            participant->in_use.store(false, std::memory_order_release); // reused by the next thread.
+        }
+    };
+    struct Retired {
+        void *ptr;
+        void (*destroy)(void*);
+        uint64_t epoch;
+    };
+
+    std::atomic<uint64_t> global_epoch = 0;
+    std::atomic<Participant*> participants = nullptr;
+    std::mutex retire_lock;
+    ::godot::LocalVector<Retired> retired;
+
+    ~EpochDomain() {
+        for (const Retired& r : retired)
+            r.destroy(r.ptr);
+    }
+    GDRBLX_INLINE static EpochDomain& get() {
+        static EpochDomain domain;
+        return domain;
+    }
+    Participant* acquire_participant() {
+        for (Participant *p = participants.load(std::memory_order_acquire); p != nullptr; p = p->next) {
+            bool expected = false;
+            if (!p->in_use.load(std::memory_order_relaxed) && p->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+                return p;
+        }
+        // Never freed. memalloc does not honor alignas, so align by hand.
+        const size_t raw = (size_t)memalloc(sizeof(Participant) + alignof(Participant));
+        Participant *p = new ((void*)((raw + alignof(Participant) - 1) & ~(alignof(Participant) - 1))) Participant;
+        Participant *head = participants.load(std::memory_order_relaxed);
+        do {
+            p->next = head;
+        } while (!participants.compare_exchange_weak(head, p, std::memory_order_release, std::memory_order_relaxed));
+        return p;
+    }
+    GDRBLX_INLINE static Participant* current() {
+        thread_local Handle handle;
+        if (unlikely(handle.participant == nullptr))
+            handle.participant = get().acquire_participant();
+        return handle.participant;
+    }
+    uint64_t min_active_epoch() const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t min = QUIESCENT;
+        for (Participant *p = participants.load(std::memory_order_acquire); p != nullptr; p = p->next) {
+            const uint64_t e = p->epoch.load(std::memory_order_acquire);
+            if (e < min)
+                min = e;
+        }
+        return min;
+    }
+    // Takes the entries no reader can reach anymore out of the list, under retire_lock.
+    void take_ready(::godot::LocalVector<Retired>& r_ready) {
+        const uint64_t min = min_active_epoch();
+        for (uint32_t i = 0; i < retired.size();) {
+            if (retired[i].epoch < min) {
+                r_ready.push_back(retired[i]);
+                retired.remove_at_unordered(i);
+            } else {
+                i++;
+            }
+        }
+    }
+public:
+    GDRBLX_INLINE static void enter() {
+        Participant *p = current();
+        if (p->depth++ > 0)
+            return;
+        p->epoch.store(get().global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in min_active_epoch.
+    }
+    GDRBLX_INLINE static void exit() {
+        Participant *p = current();
+        if (--p->depth == 0)
+            p->epoch.store(QUIESCENT, std::memory_order_release);
+    }
+    // p_ptr must already be unreachable for readers entering from now on.
+    static void retire(void *p_ptr, void (*p_destroy)(void*)) {
+        EpochDomain& domain = get();
+        ::godot::LocalVector<Retired> ready;
+        {
+            std::lock_guard guard(domain.retire_lock);
+            const uint64_t e = domain.global_epoch.fetch_add(1, std::memory_order_seq_cst);
+            domain.retired.push_back({ p_ptr, p_destroy, e });
+            domain.take_ready(ready);
+        }
+        for (const Retired& r : ready) // outside the lock, destructors may retire more.
+            r.destroy(r.ptr);
+    }
+    template <typename T>
+    GDRBLX_INLINE static void retire(T *p_ptr) {
+        retire(p_ptr, [](void *p) { ::godot::memdelete((T*)p); });
+    }
+    // Frees what became unreachable since the last retire, the scheduler calls it once per frame.
+    static void collect() {
+        EpochDomain& domain = get();
+        ::godot::LocalVector<Retired> ready;
+        {
+            std::lock_guard guard(domain.retire_lock);
+            if (domain.retired.is_empty())
+                return;
+            domain.take_ready(ready);
+        }
+        for (const Retired& r : ready)
+            r.destroy(r.ptr);
+    }
+}; // class EpochDomain
+
+// Read section, data loaded inside it stays alive until the guard is gone.
+class EpochGuard final {
+public:
+    GDRBLX_INLINE EpochGuard() {
+        EpochDomain::enter();
+    }
+    GDRBLX_INLINE ~EpochGuard() {
+        EpochDomain::exit();
+    }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+}; // class EpochGuard
+
+} // namespace internal
+
+} // namespace gdrblx
+
+#endif // EPOCH_HPP
@@ -0,0 +1,188 @@
+#include "format.hpp"
+
+#include <cstdio>
+
+#include <godot_cpp/core/math.hpp>
+
+namespace gdrblx {
+
+namespace internal {
+
+static constexpr const char FORMAT_FLAGS[] = "-+ #0";
+static constexpr size_t FORMAT_MAX_SPEC = 32;
+static constexpr size_t FORMAT_MAX_ITEM = 512;
+
+static void format_add_quoted(luaL_Strbuf *p_buf, const char *p_s, size_t p_l) {
+    luaL_addchar(p_buf, '"');
+    for (size_t idx = 0; idx < p_l; idx++) {
+        const char c = p_s[idx];
+        switch (c) {
+            case '"':
+            case '\\':
+            case '\n':
+                luaL_addchar(p_buf, '\\');
+                luaL_addchar(p_buf, c);
+                break;
+            case '\r':
+                luaL_addlstring(p_buf, "\\r", 2);
+                break;
+            case '\0':
+                luaL_addlstring(p_buf, "\\000", 4);
+                break;
+            default:
+                luaL_addchar(p_buf, c);
+                break;
+        }
+    }
+    luaL_addchar(p_buf, '"');
+}
+
+static double format_as_number(const LuaFormatArg& p_arg) {
+    switch (p_arg.kind) {
+        case LuaFormatArg::INT:
+            return (double)p_arg.i;
+        case LuaFormatArg::UINT:
+            return (double)p_arg.u;
+        case LuaFormatArg::NUM:
+            return p_arg.n;
+        default:
+            return 0;
+    }
+}
+
+static long long format_as_integer(const LuaFormatArg& p_arg) {
+    switch (p_arg.kind) {
+        case LuaFormatArg::INT:
+            return p_arg.i;
+        case LuaFormatArg::UINT:
+            return (long long)p_arg.u;
+        case LuaFormatArg::NUM:
+            return (long long)p_arg.n;
+        default:
+            return 0;
+    }
+}
+
+bool format_to_buffer(luaL_Strbuf *p_buf, const char *p_fmt, size_t p_fmt_len, const LuaFormatArg *p_args, size_t p_nargs) {
+    const char *strfrmt = p_fmt;
+    const char *strfrmt_end = p_fmt + p_fmt_len;
+    size_t arg = 0;
+    char spec[FORMAT_MAX_SPEC];
+    char item[FORMAT_MAX_ITEM];
+
+    while (strfrmt < strfrmt_end) {
+        if (*strfrmt != '%') {
+            const char *run = strfrmt;
+            while (strfrmt < strfrmt_end && *strfrmt != '%')
+                strfrmt++;
+            luaL_addlstring(p_buf, run, strfrmt - run);
+            continue;
+        }
+        if (++strfrmt >= strfrmt_end)
+            return false;
+        if (*strfrmt == '%') {
+            luaL_addchar(p_buf, '%');
+            strfrmt++;
+            continue;
+        }
+
+        // %[flags][width][.precision]conversion
+        const char *spec_begin = strfrmt;
+        while (strfrmt < strfrmt_end && *strfrmt != '\0' && strchr(FORMAT_FLAGS, *strfrmt)) {
+            if ((size_t)(++strfrmt - spec_begin) > sizeof(FORMAT_FLAGS) - 1)
+                return false; // repeated flags, string.format raises the error.
+        }
+        for (int digits = 0; digits < 2 && strfrmt < strfrmt_end && *strfrmt >= '0' && *strfrmt <= '9'; digits++)
+            strfrmt++;
+        const char *precision = nullptr;
+        if (strfrmt < strfrmt_end && *strfrmt == '.') {
+            precision = ++strfrmt;
+            for (int digits = 0; digits < 2 && strfrmt < strfrmt_end && *strfrmt >= '0' && *strfrmt <= '9'; digits++)
+                strfrmt++;
+        }
+        if (strfrmt >= strfrmt_end || arg >= p_nargs)
+            return false;
+        const size_t modifiers = strfrmt - spec_begin;
+        const char conversion = *strfrmt++;
+        const LuaFormatArg& a = p_args[arg++];
+
+        spec[0] = '%';
+        memcpy(spec + 1, spec_begin, modifiers);
+        size_t spec_len = 1 + modifiers;
+
+        int written = 0;
+        switch (conversion) {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'x':
+            case 'X':
+                if (a.kind == LuaFormatArg::STR)
+                    return false; // numeric strings and the error for anything else.
+                spec[spec_len++] = 'l';
+                spec[spec_len++] = 'l';
+                spec[spec_len++] = conversion;
+                spec[spec_len] = '\0';
+                written = snprintf(item, FORMAT_MAX_ITEM, spec, format_as_integer(a));
+                break;
+            case 'c':
+                if (a.kind == LuaFormatArg::STR)
+                    return false;
+                spec[spec_len++] = 'c';
+                spec[spec_len] = '\0';
+                written = snprintf(item, FORMAT_MAX_ITEM, spec, (int)format_as_integer(a));
+                break;
+            case 'f':
+            case 'g':
+            case 'G':
+            case 'e':
+            case 'E':
+                if (a.kind == LuaFormatArg::STR)
+                    return false;
+                spec[spec_len++] = conversion;
+                spec[spec_len] = '\0';
+                written = snprintf(item, FORMAT_MAX_ITEM, spec, format_as_number(a));
+                break;
+            case 's': {
+                if (a.kind != LuaFormatArg::STR)
+                    return false; // numbers go through tostring like in Luau.
+                if (modifiers == 0) {
+                    luaL_addlstring(p_buf, a.s, a.l); // no copy through snprintf for the common case.
+                    continue;
+                }
+                // the data is not NUL terminated, the precision always bounds what is read.
+                size_t len = a.l;
+                if (precision != nullptr) {
+                    size_t p = 0;
+                    for (const char *c = precision; c < strfrmt - 1; c++)
+                        p = p * 10 + (*c - '0');
+                    len = MIN(len, p);
+                }
+                if (len >= FORMAT_MAX_ITEM)
+                    return false;
+                spec_len = 1 + ((precision != nullptr ? precision - 1 : strfrmt - 1) - spec_begin);
+                spec[spec_len++] = '.';
+                spec[spec_len++] = '*';
+                spec[spec_len++] = 's';
+                spec[spec_len] = '\0';
+                written = snprintf(item, FORMAT_MAX_ITEM, spec, (int)len, a.s);
+                break;
+            }
+            case 'q':
+                if (a.kind != LuaFormatArg::STR)
+                    return false;
+                format_add_quoted(p_buf, a.s, a.l);
+                continue;
+            default:
+                return false;
+        }
+        if (written < 0 || (size_t)written >= FORMAT_MAX_ITEM)
+            return false; // would be truncated.
+        luaL_addlstring(p_buf, item, written);
+    }
+    return true;
+}
+
+} // namespace internal
+
+} // namespace gdrblx
@@ -0,0 +1,62 @@
+#ifndef FORMAT_HPP
+#define FORMAT_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include <lua.h>
+#include <lualib.h>
+
+#include "macros.hpp"
+#include "string.hpp"
+
+namespace gdrblx {
+
+namespace internal {
+
+// Argument of the native string.format subset used by LuauCtx::stringf and errorf.
+class LuaFormatArg {
+public:
+    enum Kind {
+        INT,
+        UINT,
+        NUM,
+        STR,
+    };
+    Kind kind;
+    union {
+        long long i;
+        unsigned long long u;
+        double n;
+        struct {
+            const char *s;
+            size_t l;
+        };
+    };
+
+    template <typename T> requires (std::is_integral_v<T> && std::is_signed_v<T> && !std::is_same_v<T, bool>)
+    GDRBLX_INLINE LuaFormatArg(T p_int) : kind(INT), i(p_int) {}
+    template <typename T> requires (std::is_integral_v<T> && std::is_unsigned_v<T> && !std::is_same_v<T, bool>)
+    GDRBLX_INLINE LuaFormatArg(T p_int) : kind(UINT), u(p_int) {}
+    template <typename T> requires std::is_floating_point_v<T>
+    GDRBLX_INLINE LuaFormatArg(T p_num) : kind(NUM), n(p_num) {}
+    GDRBLX_INLINE LuaFormatArg(bool p_bool) : kind(STR), s(p_bool ? "true" : "false"), l(p_bool ? 4 : 5) {}
+    GDRBLX_INLINE LuaFormatArg(const char *p_str) : kind(STR), s(p_str ? p_str : "(null)"), l(strlen(p_str ? p_str : "(null)")) {}
+    GDRBLX_INLINE LuaFormatArg(const LuaString& p_str) : kind(STR), s(p_str.s ? p_str.s : ""), l(p_str.s ? p_str.l : 0) {}
+};
+
+template <typename T>
+concept LuaFormattable = requires(T p_o) { LuaFormatArg(p_o); };
+
+// Formats into a Luau string buffer, supports %d %i %u %x %X %c %f %g %e %s %q and %%, with flags, width and precision.
+// Returns false on an invalid option, when arguments run out or when the result would differ from Luau's
+// (tostring of numbers, string to number coercion, items longer than the scratch buffer),
+// the buffer then contains the partial result.
+bool format_to_buffer(luaL_Strbuf *p_buf, const char *p_fmt, size_t p_fmt_len, const LuaFormatArg *p_args, size_t p_nargs);
+
+} // namespace internal
+
+} // namespace gdrblx
+
+#endif // FORMAT_HPP
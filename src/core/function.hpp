@@ -94,6 +94,19 @@ public:
             break;
         }
     }
+    GDRBLX_INLINE LuaFunction(LuaFunction&& p_other) : type(p_other.type) {
+        switch (type) {
+        case LCFUNC:
+            new (&lc) CompiledLua(std::move(p_other.lc));
+            break;
+        case CFUNC:
+            new (&cf) CFunc(std::move(p_other.cf));
+            break;
+        case SFUNC:
+            new (&l) LuaObject(std::move(p_other.l));
+            break;
+        }
+    }
     GDRBLX_INLINE LuaFunction(const LuaObject& p_local) : type(SFUNC), l(p_local) {
         CRASH_COND(!p_local.is_type(LuaObject::FUNCTION));
     }
@@ -130,10 +143,19 @@ public:
     void set_upvalue(LuaString p_name, LuaObject p_val);
 
     LuaFunction& operator=(const LuaFunction& p_other) {
+        if (this == &p_other)
+            return *this;
         this->~LuaFunction();
         new (this) LuaFunction(p_other);
         return *this;
     }
+    LuaFunction& operator=(LuaFunction&& p_other) {
+        if (this == &p_other)
+            return *this;
+        this->~LuaFunction();
+        new (this) LuaFunction(std::move(p_other));
+        return *this;
+    }
 };
 
 }; // namespace gdrblx
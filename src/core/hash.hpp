@@ -0,0 +1,118 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "macros.hpp"
+
+namespace gdrblx {
+
+namespace internal {
+
+// wyhash (final version 4), reads 8 bytes per step instead of djb2's one.
+namespace wyhash {
+
+static constexpr uint64_t SECRET[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+GDRBLX_INLINE static void mum(uint64_t *p_a, uint64_t *p_b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = *p_a;
+    r *= *p_b;
+    *p_a = (uint64_t)r;
+    *p_b = (uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *p_a = _umul128(*p_a, *p_b, p_b);
+#else
+    uint64_t ha = *p_a >> 32, hb = *p_b >> 32, la = (uint32_t)*p_a, lb = (uint32_t)*p_b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *p_a = lo;
+    *p_b = hi;
+#endif
+}
+GDRBLX_INLINE static uint64_t mix(uint64_t p_a, uint64_t p_b) {
+    mum(&p_a, &p_b);
+    return p_a ^ p_b;
+}
+GDRBLX_INLINE static uint64_t read8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+GDRBLX_INLINE static uint64_t read4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+GDRBLX_INLINE static uint64_t read3(const uint8_t *p, size_t k) {
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+GDRBLX_INLINE static uint64_t hash(const void *p_key, size_t p_len, uint64_t p_seed = 0) {
+    const uint8_t *p = (const uint8_t*)p_key;
+    uint64_t seed = p_seed ^ mix(p_seed ^ SECRET[0], SECRET[1]);
+    uint64_t a, b;
+    if (p_len <= 16) {
+        if (p_len >= 4) {
+            a = (read4(p) << 32) | read4(p + ((p_len >> 3) << 2));
+            b = (read4(p + p_len - 4) << 32) | read4(p + p_len - 4 - ((p_len >> 3) << 2));
+        } else if (p_len > 0) {
+            a = read3(p, p_len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = p_len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = mix(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+                see1 = mix(read8(p + 16) ^ SECRET[2], read8(p + 24) ^ see1);
+                see2 = mix(read8(p + 32) ^ SECRET[3], read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mix(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read8(p + i - 16);
+        b = read8(p + i - 8);
+    }
+    a ^= SECRET[1];
+    b ^= seed;
+    mum(&a, &b);
+    return mix(a ^ SECRET[0] ^ p_len, b ^ SECRET[1]);
+}
+
+} // namespace wyhash
+
+// 32 bit hash for the godot HashMap, never 0 so 0 can mark an uncomputed cached hash.
+GDRBLX_INLINE static uint32_t hash_bytes(const void *p_key, size_t p_len) {
+    uint64_t h = wyhash::hash(p_key, p_len);
+    uint32_t folded = (uint32_t)(h ^ (h >> 32));
+    return folded != 0 ? folded : 1;
+}
+GDRBLX_INLINE static uint32_t hash_u64(uint64_t p_value) {
+    uint64_t h = wyhash::mix(p_value ^ wyhash::SECRET[0], wyhash::SECRET[1]);
+    uint32_t folded = (uint32_t)(h ^ (h >> 32));
+    return folded != 0 ? folded : 1;
+}
+
+} // namespace internal
+
+} // namespace gdrblx
+
+#endif // HASH_HPP
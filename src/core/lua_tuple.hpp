@@ -1,6 +1,8 @@
 #ifndef LUA_TUPLE_HPP
 #define LUA_TUPLE_HPP
 
+#include <utility>
+
 #include "object.hpp"
 
 namespace gdrblx {
@@ -10,23 +12,26 @@ class LuaTuple final {
 
     template <typename T, typename... Args>
     constexpr void push_objects(T p_o, Args... p_args) {
-        objects.push_back(p_o);
-        push_objects(p_args...);
+        objects.push_back(std::move(p_o));
+        push_objects(std::move(p_args)...);
     }
     template <typename T>
     constexpr void push_objects(T p_o) {
-        objects.push_back(p_o);
+        objects.push_back(std::move(p_o));
     }
     constexpr void push_objects() {}
 public:
     template <typename... Args>
-    LuaTuple(Args... p_args) {push_objects(p_args...);}
+    LuaTuple(Args... p_args) {push_objects(std::move(p_args)...);}
 
     LuaTuple(const LuaTuple& p_other) : objects(p_other.objects) {}
     LuaTuple(LuaTuple&& p_other) : objects(std::move(p_other.objects)) {}
     
     LuaTuple(const Vec<LuaObject>& p_objects) : objects(p_objects) {}
-    LuaTuple(Vec<LuaObject>&& p_objects) : objects(p_objects) {}
+    LuaTuple(Vec<LuaObject>&& p_objects) : objects(std::move(p_objects)) {}
+
+    LuaTuple& operator=(const LuaTuple& p_other) = default;
+    LuaTuple& operator=(LuaTuple&& p_other) = default;
 
     size_t get_size() const {
         return objects.size();
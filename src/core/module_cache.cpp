@@ -0,0 +1,203 @@
+#include "module_cache.hpp"
+
+#include <mutex>
+
+#include <vm.hpp>
+#include <userdata/instance/instance.hpp>
+
+#include "context.hpp"
+#include "scheduler.hpp"
+#include "table.hpp"
+
+namespace gdrblx {
+
+// Suspends a thread until the thread loading the module of its state is done.
+class ModuleCache::LoadAwaiter final {
+    ModuleCache *cache;
+    uint64_t id;
+    const LuauCtx *ctx;
+public:
+    GDRBLX_INLINE LoadAwaiter(ModuleCache *p_cache, uint64_t p_id, const LuauCtx *p_ctx) : cache(p_cache), id(p_id), ctx(p_ctx) {}
+
+    GDRBLX_INLINE bool await_ready() const { return false; }
+    GDRBLX_INLINE bool await_suspend(LuaNativeTask::Handle p_handle) {
+        return cache->wait(&(LuauState&)ctx->state, id, (LuaThread)*ctx);
+    }
+    GDRBLX_INLINE void await_resume() const {}
+};
+
+ModuleCache::Lookup ModuleCache::lookup(LuauState* p_state, lua_State* p_L, uint64_t p_id, LuaObject& r_value) {
+    {
+        std::shared_lock guard(lock);
+        auto it = modules.find(p_id);
+        if (it != modules.end()) {
+            auto local = it->value.local.find(p_state);
+            if (local != it->value.local.end()) {
+                r_value = local->value;
+                return FOUND;
+            }
+            auto loader = it->value.loading.find(p_state);
+            if (loader != it->value.loading.end())
+                return loader->value == p_L ? RECURSIVE : WAIT;
+        }
+    }
+
+    std::unique_lock guard(lock);
+    ModuleEntry& entry = modules[p_id];
+    auto local = entry.local.find(p_state);
+    if (local != entry.local.end()) { // filled between the locks.
+        r_value = local->value;
+        return FOUND;
+    }
+    if (entry.has_shared) {
+        r_value = entry.shared.share_in(p_state);
+        entry.local.insert(p_state, r_value);
+        return FOUND;
+    }
+    auto loader = entry.loading.find(p_state);
+    if (loader != entry.loading.end())
+        return loader->value == p_L ? RECURSIVE : WAIT;
+    entry.loading.insert(p_state, p_L);
+    return LOAD;
+}
+
+bool ModuleCache::wait(LuauState* p_state, uint64_t p_id, const LuaThread& p_thread) {
+    std::unique_lock guard(lock);
+    auto it = modules.find(p_id);
+    if (it == modules.end() || !it->value.loading.has(p_state))
+        return false;
+    it->value.waiting[p_state].push_back(p_thread);
+    return true;
+}
+
+bool ModuleCache::is_frozen_data(lua_State* p_L, int p_idx, LocalVec<const void*>& r_seen) {
+    switch (lua_type(p_L, p_idx)) {
+        case LUA_TNIL:
+        case LUA_TBOOLEAN:
+        case LUA_TNUMBER:
+        case LUA_TSTRING:
+            return true;
+        case LUA_TTABLE:
+            break;
+        default:
+            return false;
+    }
+    if (!lua_getreadonly(p_L, p_idx))
+        return false;
+    const void *t = lua_topointer(p_L, p_idx);
+    for (const void *seen : r_seen) { // cycles
+        if (seen == t)
+            return true;
+    }
+    r_seen.push_back(t);
+    if (!lua_checkstack(p_L, 2))
+        return false;
+    p_idx = p_idx < 0 ? lua_gettop(p_L) + p_idx + 1 : p_idx;
+    lua_pushnil(p_L);
+    while (lua_next(p_L, p_idx) != 0) {
+        if (!is_frozen_data(p_L, -2, r_seen) || !is_frozen_data(p_L, -1, r_seen)) {
+            lua_pop(p_L, 2);
+            return false;
+        }
+        lua_pop(p_L, 1);
+    }
+    return true;
+}
+
+LuaObject ModuleCache::finish(LuauState* p_state, lua_State* p_L, uint64_t p_id, const LuaObject* p_value) {
+    LuaObject native;
+    bool shareable = false;
+    if (p_value != nullptr && p_value->can_clone()) {
+        bool frozen;
+        if (p_value->is_stack()) {
+            LuaObject v = *p_value;
+            LocalVec<const void*> seen;
+            v.push(p_L);
+            frozen = is_frozen_data(p_L, -1, seen);
+            lua_pop(p_L, 1);
+        } else {
+            frozen = p_value->is_immutable();
+        }
+        if (frozen) { // only copied once it is known to seal.
+            native = p_value->clone();
+            shareable = native.seal();
+        }
+    }
+
+    LuaObject value;
+    LocalVec<LuaThread> waiting;
+    {
+        std::unique_lock guard(lock);
+        ModuleEntry& entry = modules[p_id];
+        entry.loading.erase(p_state);
+        auto it = entry.waiting.find(p_state);
+        if (it != entry.waiting.end()) {
+            waiting = std::move(it->value);
+            entry.waiting.erase(p_state);
+        }
+        if (p_value != nullptr) {
+            if (shareable && !entry.has_shared) {
+                entry.shared = native;
+                entry.has_shared = true;
+            }
+            value = p_value->clone_in(p_state);
+            entry.local.insert(p_state, value);
+        }
+    }
+    // they look the module up again, and run it themselves if it errored.
+    for (const LuaThread& thr : waiting)
+        p_state->get_scheduler()->defer(thr);
+    return value;
+}
+
+void ModuleCache::invalidate(uint64_t p_id) {
+    std::unique_lock guard(lock);
+    modules.erase(p_id);
+}
+
+void ModuleCache::release_state(LuauState* p_state) {
+    std::unique_lock guard(lock);
+    for (auto& kv : modules) {
+        kv.value.local.erase(p_state);
+        kv.value.loading.erase(p_state);
+        kv.value.waiting.erase(p_state);
+    }
+}
+
+LuaNativeTask ModuleCache::lua_require(lua_State *L) {
+    LuauFnCtx ctx = L;
+    ctx.expect_argn(1);
+    Arc<Instance> module = ctx.expect(1, UD_INSTANCE).as_userdata<Instance>();
+    Option<LuaFunction> func = module.read()->get_module_function(ctx);
+    if (!func.exists)
+        co_await LuaNativeTask::raise(LuaObject("Attempted to call require with invalid argument(s)."));
+    uint64_t id = module.read()->UniqueId;
+    ModuleCache& cache = ((RobloxVM&)ctx.vm).modules;
+    LuauState* state = &(LuauState&)ctx.state;
+
+    LuaObject cached;
+    Lookup status;
+    while ((status = cache.lookup(state, L, id, cached)) == WAIT)
+        co_await LoadAwaiter(&cache, id, &ctx);
+    if (status == RECURSIVE)
+        co_await LuaNativeTask::raise(LuaObject("Requested module was required recursively"));
+    if (status == FOUND)
+        co_return ctx.return_call(cached);
+
+    // The module may yield or require other modules, so dont hold the lock while it runs.
+    Result<LuaObject, LuaObject> result = ctx.pcall(func.unwrap());
+    if (result.is_err()) {
+        cache.finish(state, L, id, nullptr);
+        co_await LuaNativeTask::raise(result.get_error());
+    }
+    LuaObject value = result.get_result();
+    co_return ctx.return_call(cache.finish(state, L, id, &value));
+}
+
+void ModuleCache::open(LuauState* p_state) {
+    LuauCtx ctx = p_state->L;
+    LuaObject g = ctx.globals;
+    g.rawset("require", native_coroutine<lua_require>("require"));
+}
+
+} // namespace gdrblx
@@ -0,0 +1,65 @@
+#ifndef MODULE_CACHE_HPP
+#define MODULE_CACHE_HPP
+
+#include <shared_mutex>
+
+#include <lua.h>
+
+#include <godot_cpp/templates/hash_map.hpp>
+
+#include "macros.hpp"
+#include "object.hpp"
+#include "function.hpp"
+#include "thread.hpp"
+#include "native_coroutine.hpp"
+
+namespace gdrblx {
+
+class LuauCtx;
+
+// Per VM cache of require() results.
+// Modules returning a frozen table or pure data are run once and the result is
+// shared read-only with every LuauState (Actors included), anything else is
+// cached per state like Roblox does.
+// Every state keeps the value it got the first time, so require(m) == require(m).
+class ModuleCache final {
+    class LoadAwaiter;
+
+    struct ModuleEntry {
+        bool has_shared = false;
+        LuaObject shared;
+        HashMap<LuauState*, LuaObject> local; // shared results too, materialized once per state.
+        HashMap<LuauState*, lua_State*> loading; // thread running the module.
+        HashMap<LuauState*, LocalVec<LuaThread>> waiting; // other threads of the state requiring it meanwhile.
+    };
+    enum Lookup {
+        FOUND,
+        LOAD,
+        WAIT,
+        RECURSIVE
+    };
+    HashMap<uint64_t, ModuleEntry> modules;
+    mutable std::shared_mutex lock;
+
+    Lookup lookup(LuauState* p_state, lua_State* p_L, uint64_t p_id, LuaObject& r_value);
+    // False if the load already finished, the thread is resumed once it does otherwise.
+    bool wait(LuauState* p_state, uint64_t p_id, const LuaThread& p_thread);
+    // p_value is null if the module errored. p_L is the thread that ran it.
+    LuaObject finish(LuauState* p_state, lua_State* p_L, uint64_t p_id, const LuaObject* p_value);
+    // Frozen tables of primitives and strings, checked in place so mutable results are never copied.
+    static bool is_frozen_data(lua_State* p_L, int p_idx, LocalVec<const void*>& r_seen);
+public:
+    // Drops every cached result of the module, next require() runs it again.
+    void invalidate(uint64_t p_id);
+    // Drops every state local result owned by the state, called by ~LuauState.
+    void release_state(LuauState* p_state);
+
+    // Threads of the same state requiring a module while it loads wait for it, so this may yield.
+    static LuaNativeTask lua_require(lua_State *L);
+    // Sets the global require() of the state.
+    static void open(LuauState* p_state);
+}; // class ModuleCache
+
+} // namespace gdrblx
+
+#endif // MODULE_CACHE_HPP
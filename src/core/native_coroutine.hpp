@@ -0,0 +1,228 @@
+#ifndef NATIVE_COROUTINE_HPP
+#define NATIVE_COROUTINE_HPP
+
+#include <coroutine>
+
+#include <lua.h>
+#include <lualib.h>
+
+#include <godot_cpp/core/memory.hpp>
+
+#include "macros.hpp"
+#include "state.hpp"
+#include "stack_view.hpp"
+#include "function.hpp"
+
+namespace gdrblx {
+
+namespace internal {
+
+// Per thread free lists for coroutine frames, sized in powers of two.
+// Frames bigger than the largest class go straight to memalloc.
+class NativeFramePool final {
+    static constexpr size_t MIN_CLASS_SHIFT = 6; // 64 bytes
+    static constexpr size_t CLASS_COUNT = 6; // up to 2048 bytes
+    static constexpr size_t MAX_CACHED = 64; // per class
+
+    struct FreeFrame {
+        FreeFrame *next;
+    };
+    struct Bucket {
+        FreeFrame *head = nullptr;
+        size_t count = 0;
+    };
+    struct Buckets {
+        Bucket buckets[CLASS_COUNT];
+        ~Buckets() {
+            for (Bucket& b : buckets) {
+                while (b.head != nullptr) {
+                    FreeFrame *f = b.head;
+                    b.head = f->next;
+                    memfree(f);
+                }
+            }
+        }
+    };
+    static Buckets& get_buckets() {
+        thread_local Buckets buckets;
+        return buckets;
+    }
+    GDRBLX_INLINE static size_t get_class(size_t p_size) {
+        size_t cls = 0;
+        while (cls < CLASS_COUNT && (size_t(1) << (cls + MIN_CLASS_SHIFT)) < p_size)
+            cls++;
+        return cls;
+    }
+public:
+    static void* allocate(size_t p_size) {
+        size_t cls = get_class(p_size);
+        if (cls == CLASS_COUNT)
+            return memalloc(p_size);
+        Bucket& b = get_buckets().buckets[cls];
+        if (b.head != nullptr) {
+            FreeFrame *f = b.head;
+            b.head = f->next;
+            b.count--;
+            return f;
+        }
+        return memalloc(size_t(1) << (cls + MIN_CLASS_SHIFT));
+    }
+    static void release(void* p_ptr, size_t p_size) {
+        size_t cls = get_class(p_size);
+        if (cls == CLASS_COUNT) {
+            memfree(p_ptr);
+            return;
+        }
+        Bucket& b = get_buckets().buckets[cls];
+        if (b.count >= MAX_CACHED) {
+            memfree(p_ptr);
+            return;
+        }
+        FreeFrame *f = (FreeFrame*)p_ptr;
+        f->next = b.head;
+        b.head = f;
+        b.count++;
+    }
+};
+
+} // namespace internal
+
+// Return type of yielding native functions written as C++20 coroutines.
+// `co_await` suspends the Luau thread, `co_return` the amount of values pushed.
+//
+//   LuaNativeTask my_func(lua_State *L) {
+//       LuauFnCtx ctx = L;
+//       double elapsed = co_await ctx.wait(1);
+//       co_return ctx.return_call(elapsed);
+//   }
+//   LuaFunction f = native_coroutine<my_func>("my_func");
+class LuaNativeTask final {
+public:
+    struct promise_type {
+        lua_State *L = nullptr;
+        int nresults = 0;
+        void *outer_frame = nullptr; // next frame of the thread, see native_coroutine_step.
+        LuaObject error;
+        bool failed = false;
+
+        GDRBLX_INLINE LuaNativeTask get_return_object() {
+            return LuaNativeTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        GDRBLX_INLINE std::suspend_always initial_suspend() noexcept { return {}; }
+        GDRBLX_INLINE std::suspend_always final_suspend() noexcept { return {}; }
+        GDRBLX_INLINE void return_value(int p_nresults) { nresults = p_nresults; }
+        // Never called, the module builds without exceptions. Luau errors raised in the body
+        // unwind through the frame like through any C function, it stays on the thread's chain.
+        GDRBLX_INLINE void unhandled_exception() {}
+
+        GDRBLX_INLINE static void* operator new(size_t p_size) {
+            return internal::NativeFramePool::allocate(p_size);
+        }
+        GDRBLX_INLINE static void operator delete(void* p_ptr, size_t p_size) {
+            internal::NativeFramePool::release(p_ptr, p_size);
+        }
+
+        // Arguments the thread was resumed with, valid inside await_resume.
+        // Luau rebases the frame of a yielded C function onto them, they start at 1.
+        GDRBLX_INLINE LuaStackView get_resume_args() const {
+            return LuaStackView(L, 1, lua_gettop(L));
+        }
+    };
+    using Handle = std::coroutine_handle<promise_type>;
+
+    // `co_await LuaNativeTask::raise(err)` instead of ctx.error in a body. The frame is destroyed
+    // at this suspension point before the error is raised, so every local in it is released.
+    struct Raise {
+        LuaObject error;
+
+        GDRBLX_INLINE bool await_ready() const { return false; }
+        GDRBLX_INLINE void await_suspend(Handle p_handle) {
+            p_handle.promise().error = std::move(error);
+            p_handle.promise().failed = true;
+        }
+        GDRBLX_INLINE void await_resume() const {}
+    };
+    GDRBLX_INLINE static Raise raise(const LuaObject& p_error) { return Raise{ p_error }; }
+
+    Handle handle;
+
+    GDRBLX_INLINE explicit LuaNativeTask(Handle p_handle) : handle(p_handle) {}
+};
+
+namespace internal {
+
+// Destroys the frames on top of p_until, null for the whole chain.
+inline void release_native_frames(LuauThreadData *p_data, void *p_until) {
+    while (p_data->native_frame != p_until) {
+        LuaNativeTask::Handle handle = LuaNativeTask::Handle::from_address(p_data->native_frame);
+        p_data->native_frame = handle.promise().outer_frame;
+        handle.destroy();
+    }
+}
+
+// Runs the frame until it finishes or suspends, yielding the Luau thread in the latter case.
+// Frames of a thread form a chain in its data, nested ones (a module requiring another) on top.
+// A frame is on it before the body runs, so one a Luau error unwound through is still found:
+// by its caller's step if a pcall there caught the error, by the next yield, since Luau does not
+// yield across C calls and nothing below can still be running then, or once the thread is dead.
+inline int native_coroutine_step(lua_State *L, LuaNativeTask::Handle p_handle) {
+    LuauThreadData *data = LuauState::get_thread_data(L);
+    LuaNativeTask::promise_type& promise = p_handle.promise();
+    if (data != nullptr) {
+        if (data->native_frame != p_handle.address()) // resumed frames are on top already.
+            promise.outer_frame = data->native_frame;
+        data->native_frame = p_handle.address();
+    }
+    p_handle.resume();
+    if (data != nullptr)
+        release_native_frames(data, p_handle.address());
+    if (promise.failed) {
+        if (data != nullptr)
+            data->native_frame = promise.outer_frame;
+        promise.error.push(L);
+        p_handle.destroy();
+        lua_error(L);
+    }
+    if (p_handle.done()) {
+        int nresults = promise.nresults;
+        if (data != nullptr)
+            data->native_frame = promise.outer_frame;
+        p_handle.destroy();
+        return nresults;
+    }
+    // the awaiter already scheduled the resumption.
+    if (data == nullptr) {
+        p_handle.destroy();
+        luaL_error(L, "cannot yield a native coroutine from a thread without thread data");
+    }
+    data->native_frame = promise.outer_frame;
+    release_native_frames(data, nullptr);
+    promise.outer_frame = nullptr;
+    data->native_frame = p_handle.address();
+    return lua_yield(L, 0);
+}
+
+inline int native_coroutine_continuation(lua_State *L, int p_status) {
+    LuauThreadData *data = LuauState::get_thread_data(L);
+    if (data == nullptr || data->native_frame == nullptr)
+        luaL_error(L, "native coroutine resumed without a suspended frame");
+    return native_coroutine_step(L, LuaNativeTask::Handle::from_address(data->native_frame));
+}
+
+} // namespace internal
+
+template <LuaNativeTask (*F)(lua_State*)>
+int lua_native_coroutine(lua_State *L) {
+    LuaNativeTask task = F(L);
+    task.handle.promise().L = L;
+    return internal::native_coroutine_step(L, task.handle);
+}
+
+template <LuaNativeTask (*F)(lua_State*)>
+inline LuaFunction native_coroutine(LuaString p_name) {
+    return LuaFunction(lua_native_coroutine<F>, p_name, internal::native_coroutine_continuation);
+}
+
+} // namespace gdrblx
+
+#endif // NATIVE_COROUTINE_HPP
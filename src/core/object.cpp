@@ -0,0 +1,274 @@
+#include "object.hpp"
+
+#include "object_header.hpp"
+#include "state.hpp"
+
+namespace gdrblx {
+
+void LuaObject::copy_slow(const LuaObject& p_other) {
+    switch (type) {
+        case STRING:
+            str->incref();
+            break;
+        case USERDATA:
+            userdata->mtx.lock();
+            userdata->ref_count++;
+            userdata->mtx.unlock();
+            break;
+        default:
+            if (header != nullptr)
+                header->incref();
+            break;
+    }
+}
+
+void LuaObject::destroy_slow() {
+    switch (type) {
+        case STRING:
+            str->decref();
+            break;
+        case USERDATA: {
+            Arc<internal::LuaUserdataBase> release(userdata, (size_t)aux); // adopts the reference and drops it.
+            break;
+        }
+        default:
+            if (header != nullptr)
+                header->decref();
+            break;
+    }
+    type = NIL;
+    header = nullptr;
+}
+
+void LuaObject::set_ref_to_nil(LuauState* p_state, size_t p_ref) {
+    p_state->unref((int)p_ref); // may run on any thread, cleared in one batch by the next flush_refs.
+}
+
+static LuaObject::Type type_from_lua(int p_type) {
+    switch (p_type) {
+        case LUA_TBOOLEAN:
+            return LuaObject::BOOLEAN;
+        case LUA_TNUMBER:
+            return LuaObject::NUMBER;
+        case LUA_TSTRING:
+            return LuaObject::STRING;
+        case LUA_TLIGHTUSERDATA:
+            return LuaObject::LIGHTUSERDATA;
+        case LUA_TUSERDATA:
+            return LuaObject::USERDATA;
+        case LUA_TTABLE:
+            return LuaObject::TABLE;
+        case LUA_TBUFFER:
+            return LuaObject::BUFFER;
+        case LUA_TFUNCTION:
+            return LuaObject::FUNCTION;
+        case LUA_TTHREAD:
+            return LuaObject::THREAD;
+        default:
+            return LuaObject::NIL;
+    }
+}
+
+LuaObject::Type LuaObject::get_type_from_weak_ref(LuauState* p_state, size_t p_ref) {
+    lua_State *L = p_state->L;
+    p_state->push_weak_ref(L, (int)p_ref);
+    const Type t = type_from_lua(lua_type(L, -1));
+    lua_pop(L, 1);
+    return t;
+}
+
+void LuaObject::set_weak_ref_to_nil(LuauState* p_state, size_t p_ref) {
+    p_state->unref_weak((int)p_ref);
+}
+
+LuaObject::LuaObject(LuauState* p_L, size_t ref_pos, const void* p_identity) : header(internal::LuaObjectHeader::create(p_L, ref_pos, p_identity)), type(REF) {}
+
+LuaObject LuaObject::weak_ref(lua_State *p_L, int p_idx) {
+    switch (lua_type(p_L, p_idx)) {
+        case LUA_TUSERDATA:
+        case LUA_TTABLE:
+        case LUA_TBUFFER:
+        case LUA_TFUNCTION:
+        case LUA_TTHREAD:
+            break;
+        default:
+            return convert(p_L, p_idx);
+    }
+    LuauState *state = LuauState::from_lua_state(p_L);
+    LuaObject o;
+    o.header = internal::LuaObjectHeader::create(state, (size_t)state->weak_ref(p_L, p_idx), lua_topointer(p_L, p_idx), true);
+    o.type = REF;
+    return o;
+}
+
+bool LuaObject::is_weak_ref() const {
+    return type == REF && header->type == internal::LuaObjectHeader::TYPE_WEAK_REF;
+}
+
+LuaObject LuaObject::lock_weak(lua_State *p_L) const {
+    if (!is_weak_ref())
+        return *this;
+    header->ref_owner->push_weak_ref(p_L, (int)header->ref_pos);
+    LuaObject strong = convert(p_L, -1);
+    lua_pop(p_L, 1);
+    return strong;
+}
+
+void LuaObject::convert_range(lua_State *p_L, int p_first, int p_count, LuaObject *r_out) {
+    if (p_count <= 0)
+        return;
+    if (p_first < 0)
+        p_first = lua_gettop(p_L) + p_first + 1;
+    for (int i = 0; i < p_count; i++) {
+        const int idx = p_first + i;
+        LuaObject& o = r_out[i];
+        DEV_ASSERT(o.type == NIL);
+        switch (lua_type(p_L, idx)) {
+            case LUA_TNIL:
+                break;
+            case LUA_TBOOLEAN:
+                o.boolean = lua_toboolean(p_L, idx);
+                o.type = BOOLEAN;
+                break;
+            case LUA_TNUMBER:
+                o.number = lua_tonumber(p_L, idx);
+                o.type = NUMBER;
+                break;
+            case LUA_TSTRING: {
+                size_t len;
+                const char *s = lua_tolstring(p_L, idx, &len);
+                o.str = internal::LuaStringData::create(s, len);
+                o.type = STRING;
+                break;
+            }
+            case LUA_TLIGHTUSERDATA:
+                o.light_userdata = lua_tolightuserdata(p_L, idx);
+                o.type = LIGHTUSERDATA;
+                break;
+            default:
+                o = convert(p_L, idx);
+                break;
+        }
+    }
+}
+
+Vec<LuaObject> LuaObject::convert_range(lua_State *p_L, int p_first, int p_count) {
+    Vec<LuaObject> vec;
+    if (p_count <= 0)
+        return vec;
+    vec.resize(p_count);
+    convert_range(p_L, p_first, p_count, vec.ptrw());
+    return vec;
+}
+
+// Collects the frozen tables reachable from p_value, false if anything mutable is found.
+bool LuaObject::collect_immutable(const LuaObject& p_value, LocalVec<const LuaTable*>& r_tables) {
+    switch (p_value.type) {
+        case NIL:
+        case BOOLEAN:
+        case INTEGER:
+        case NUMBER:
+        case STRING:
+            return true;
+        case TABLE: {
+            if (p_value.header == nullptr || p_value.header->get_header_type() != TABLE)
+                return false;
+            const LuaTable& t = p_value.header->t;
+            if (t.is_sealed())
+                return true;
+            if (!t.isfrozen())
+                return false;
+            for (const LuaTable *seen : r_tables) { // cycles
+                if (seen == &t)
+                    return true;
+            }
+            r_tables.push_back(&t);
+            for (const LuaObject& v : t.array) {
+                if (!collect_immutable(v, r_tables))
+                    return false;
+            }
+            for (const LuaTable::Node& n : t.nodes) {
+                if (n.value.type == NIL)
+                    continue;
+                if (!collect_immutable(n.key, r_tables) || !collect_immutable(n.value, r_tables))
+                    return false;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool LuaObject::is_immutable() const {
+    if (type != TABLE)
+        return type == NIL || type == BOOLEAN || type == INTEGER || type == NUMBER || type == STRING;
+    LocalVec<const LuaTable*> tables;
+    return collect_immutable(*this, tables);
+}
+
+bool LuaObject::seal() const {
+    if (type != TABLE)
+        return is_immutable();
+    LocalVec<const LuaTable*> tables;
+    if (!collect_immutable(*this, tables))
+        return false;
+    for (const LuaTable *t : tables) // only once the whole graph is known to be immutable.
+        t->sealed.store(true, std::memory_order_release);
+    return true;
+}
+
+// Integral numbers hash like integers, so 1 and 1.0 land in the same bucket.
+static GDRBLX_INLINE uint32_t hash_number(lua_Number p_num) {
+    lua_Integer i = (lua_Integer)p_num;
+    if ((lua_Number)i == p_num)
+        return internal::hash_u64((uint64_t)i);
+    if (p_num != p_num)
+        return internal::hash_u64(0x7ff8000000000000ull); // all NaNs alike.
+    uint64_t bits;
+    memcpy(&bits, &p_num, sizeof(bits));
+    return internal::hash_u64(bits);
+}
+
+uint32_t LuaObject::hash_slow() const {
+    switch (type) {
+        case NIL:
+            return 0;
+        case BOOLEAN:
+            return boolean ? 1 : 2;
+        case INTEGER:
+            return internal::hash_u64((uint64_t)integer);
+        case NUMBER:
+            return hash_number(number);
+        case STRING:
+            return hash();
+        case LIGHTUSERDATA:
+            return internal::hash_u64((uint64_t)(size_t)light_userdata);
+        case USERDATA:
+            return internal::hash_u64((uint64_t)(size_t)get_userdata_base());
+        case LOCAL: {
+            lua_State *L = local_stack_coro;
+            switch (lua_type(L, aux)) {
+                case LUA_TNIL:
+                    return 0;
+                case LUA_TBOOLEAN:
+                    return lua_toboolean(L, aux) ? 1 : 2;
+                case LUA_TNUMBER:
+                    return hash_number(lua_tonumber(L, aux));
+                case LUA_TSTRING: {
+                    size_t len;
+                    const char *s = lua_tolstring(L, aux, &len);
+                    return internal::lua_string_hash(s, len);
+                }
+                default:
+                    return internal::hash_u64((uint64_t)(size_t)lua_topointer(L, aux));
+            }
+        }
+        case REF: // by the Luau object like LOCAL, so both forms of a value land in the same bucket.
+            return internal::hash_u64((uint64_t)(size_t)header->ref_identity);
+        default:
+            return internal::hash_u64((uint64_t)(size_t)header);
+    }
+}
+
+} // namespace gdrblx
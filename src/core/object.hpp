@@ -6,6 +6,7 @@
 #include <lua.h>
 #include <lualib.h>
 #include <godot_cpp/variant/string.hpp>
+#include <godot_cpp/variant/variant.hpp>
 #include <godot_cpp/templates/hash_map.hpp>
 #include <godot_cpp/templates/vector.hpp>
 #include <godot_cpp/templates/local_vector.hpp>
@@ -50,22 +51,12 @@ class LuaObject final { // mark as final till required to inherit. no virtual de
     friend class LuaThread;
     friend class LuauCtx;
     friend class LuauFnCtx;
+    friend class LuaStackView;
+    friend class LuaTable;
+    friend class SharedTable;
 
-    union {
-        internal::LuaObjectHeader *header = nullptr;
-        const bool boolean;
-        const lua_Integer integer;
-        const Arc<internal::LuaUserdataBase> userdata;
-        const lua_Number number;
-        const LuaString str;
-        const void* light_userdata;
-        struct {
-            lua_State *const local_stack_coro;
-            const size_t local_stack_pos;
-        };
-    };
 public:
-    enum Type {
+    enum Type : uint8_t {
         NIL,
         BOOLEAN,
 
@@ -86,7 +77,39 @@ public:
         REF,
     };
 private:
-    const Type type;
+    // 8 byte payload, 4 byte auxiliary slot and the type tag, 16 bytes total.
+    union {
+        internal::LuaObjectHeader *header = nullptr;
+        bool boolean;
+        lua_Integer integer;
+        lua_Number number;
+        const void* light_userdata;
+        internal::LuaStringData *str; // shared with LuaString, refcounted.
+        internal::ArcHeader<internal::LuaUserdataBase> *userdata; // offset of LuaUserdataBase in aux.
+        lua_State *local_stack_coro; // stack position in aux.
+    };
+    int32_t aux = 0;
+    Type type;
+
+    // Types copied and destroyed as plain bytes.
+    static constexpr uint32_t TRIVIAL_TYPES = (1u << NIL) | (1u << BOOLEAN) | (1u << INTEGER) | (1u << NUMBER) | (1u << LIGHTUSERDATA) | (1u << LOCAL);
+    GDRBLX_INLINE static constexpr bool is_trivial_type(Type p_type) {
+        return (TRIVIAL_TYPES >> p_type) & 1u;
+    }
+    GDRBLX_INLINE bool is_trivial() const {
+        return is_trivial_type(type);
+    }
+    GDRBLX_INLINE int local_stack_pos() const {
+        return aux;
+    }
+    void copy_slow(const LuaObject& p_other);
+    void destroy_slow();
+    uint32_t hash_slow() const;
+    static bool collect_immutable(const LuaObject& p_value, LocalVec<const LuaTable*>& r_tables);
+
+    GDRBLX_INLINE internal::LuaUserdataBase* get_userdata_base() const {
+        return (internal::LuaUserdataBase*)((size_t)userdata->object + aux);
+    }
 
     constexpr static const char* static_get_typename(Type p_type) {
         switch (p_type) {
@@ -123,12 +146,19 @@ private:
 
     static Type get_type_from_ref(LuauState* p_state, size_t p_ref);
     static void set_ref_to_nil(LuauState* p_state, size_t p_ref);
+    static Type get_type_from_weak_ref(LuauState* p_state, size_t p_ref);
+    static void set_weak_ref_to_nil(LuauState* p_state, size_t p_ref);
 
     void push_to_stack(LuauState* p_state, lua_State* p_L) const;
 
-    GDRBLX_INLINE LuaObject(lua_State *p_L, size_t stack_pos) : local_stack_coro(p_L), local_stack_pos(stack_pos), type(LOCAL) {}
-    static LuaObject convert(lua_State *p_L, size_t stack_pos);
-    LuaObject(LuauState* p_L, size_t ref_pos);
+    GDRBLX_INLINE LuaObject(lua_State *p_L, int stack_pos) : local_stack_coro(p_L), aux(stack_pos), type(LOCAL) {}
+    static LuaObject convert(lua_State *p_L, int stack_pos);
+    // Converts p_count slots starting at p_first into r_out, which must hold nil objects.
+    // Primitives and strings are converted inline, in one pass over the stack.
+    static void convert_range(lua_State *p_L, int p_first, int p_count, LuaObject *r_out);
+    static Vec<LuaObject> convert_range(lua_State *p_L, int p_first, int p_count);
+    // p_identity is lua_topointer of the referenced value, REFs hash by it without touching the owner state.
+    LuaObject(LuauState* p_L, size_t ref_pos, const void* p_identity);
     LuaObject(Type t, internal::LuaObjectHeader *header);
 public:
     Type get_type() const;
@@ -136,25 +166,27 @@ public:
 
     GDRBLX_INLINE LuaObject() : type(NIL) {}
     GDRBLX_INLINE LuaObject(std::nullptr_t) : type(NIL) {}
-    GDRBLX_INLINE LuaObject(bool p_bool) : type(BOOLEAN), boolean(p_bool) {}
-    GDRBLX_INLINE LuaObject(LuaString p_str) : type(STRING), str(p_str) {}
-    GDRBLX_INLINE LuaObject(const char *p_str) : type(STRING), str(p_str) {}
-    GDRBLX_INLINE LuaObject(::godot::String p_str) : type(STRING), str(p_str) {}
-    GDRBLX_INLINE LuaObject(void *p_ptr) : type(LIGHTUSERDATA), light_userdata(p_ptr) {}
-
-    GDRBLX_INLINE LuaObject(long long p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(unsigned long long p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(uint8_t p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(int8_t p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(uint16_t p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(int16_t p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(uint32_t p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(int32_t p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(uint64_t p_int) : type(INTEGER), integer(p_int) {}
-    GDRBLX_INLINE LuaObject(int64_t p_int) : type(INTEGER), integer(p_int) {}
+    GDRBLX_INLINE LuaObject(bool p_bool) : boolean(p_bool), type(BOOLEAN) {}
+    GDRBLX_INLINE LuaObject(const LuaString& p_str) : str(p_str.share()), type(STRING) {}
+    GDRBLX_INLINE LuaObject(const char *p_str) : str(internal::LuaStringData::create(p_str, p_str ? strlen(p_str) : 0)), type(STRING) {}
+    GDRBLX_INLINE LuaObject(const ::godot::String& p_str) : str(internal::LuaStringData::create(nullptr, internal::utf8_length(p_str))), type(STRING) {
+        internal::utf8_encode(p_str, str->data);
+    }
+    GDRBLX_INLINE LuaObject(void *p_ptr) : light_userdata(p_ptr), type(LIGHTUSERDATA) {}
+
+    GDRBLX_INLINE LuaObject(long long p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(unsigned long long p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(uint8_t p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(int8_t p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(uint16_t p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(int16_t p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(uint32_t p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(int32_t p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(uint64_t p_int) : integer(p_int), type(INTEGER) {}
+    GDRBLX_INLINE LuaObject(int64_t p_int) : integer(p_int), type(INTEGER) {}
     
-    GDRBLX_INLINE LuaObject(float p_num) : type(NUMBER), number(p_num) {}
-    GDRBLX_INLINE LuaObject(double p_num) : type(NUMBER), number(p_num) {}
+    GDRBLX_INLINE LuaObject(float p_num) : number(p_num), type(NUMBER) {}
+    GDRBLX_INLINE LuaObject(double p_num) : number(p_num), type(NUMBER) {}
 
     LuaObject(const LuaFunction& p_func);
     LuaObject(const LuaThread& p_thr);
@@ -162,21 +194,36 @@ public:
     LuaObject(LuaBuffer p_buf);
     LuaObject(LuaTable p_tbl);
     LuaObject(SharedTable p_tbl);
-    LuaObject(const LuaObject& other);
+    GDRBLX_INLINE LuaObject(const LuaObject& p_other) : header(p_other.header), aux(p_other.aux), type(p_other.type) {
+        if (!is_trivial())
+            copy_slow(p_other);
+    }
+    // Steals the payload, the source is left nil.
+    GDRBLX_INLINE LuaObject(LuaObject&& p_other) : header(p_other.header), aux(p_other.aux), type(p_other.type) {
+        p_other.type = NIL;
+    }
 
     LuaObject(Type p_type);
     
     template <class T> requires IsUserdata<T>
-    LuaObject(const Arc<T>& p_userdata);
+    GDRBLX_INLINE LuaObject(const Arc<T>& p_userdata) : type(USERDATA) {
+        userdata = (internal::ArcHeader<internal::LuaUserdataBase>*)(void*)p_userdata.header;
+        T* object = (T*)((size_t)p_userdata.header->object + p_userdata.offset);
+        aux = (int32_t)((size_t)(internal::LuaUserdataBase*)object - (size_t)p_userdata.header->object);
+        userdata->mtx.lock();
+        userdata->ref_count++;
+        userdata->mtx.unlock();
+    }
     template <class T> requires IsUserdata<T>
-    GDRBLX_INLINE LuaObject(const Option<Arc<T>>& p_userdata) : type(p_userdata.exists ? LuaObject::USERDATA : LuaObject::NIL) {
+    GDRBLX_INLINE LuaObject(const Option<Arc<T>>& p_userdata) : type(NIL) {
         if (p_userdata.exists)
-            LuaObject(p_userdata.unwrap());
-        else
-            LuaObject();
+            new (this) LuaObject(p_userdata.unwrap());
     };
     
-    ~LuaObject();
+    GDRBLX_INLINE ~LuaObject() {
+        if (!is_trivial())
+            destroy_slow();
+    }
 
     operator long long() const;
     operator unsigned long long() const;
@@ -196,7 +243,7 @@ public:
     operator void*() const;
     
     template <typename T>
-    Arc<T>& operator->();
+    Arc<T> operator->();
 
     operator lua_CFunction() const;
     operator lua_Continuation() const;
@@ -208,7 +255,15 @@ public:
     
     UserdataType get_userdata_type() const;
     template <class T> requires IsUserdata<T>
-    Arc<T>& as_userdata() const;
+    GDRBLX_INLINE Arc<T> as_userdata() const {
+        DEV_ASSERT(type == USERDATA);
+        userdata->mtx.lock();
+        userdata->ref_count++;
+        userdata->mtx.unlock();
+        // aux locates the LuaUserdataBase, T may sit elsewhere in the stored object.
+        T* object = static_cast<T*>(get_userdata_base());
+        return Arc<T>((internal::ArcHeader<T>*)(void*)userdata, (size_t)object - (size_t)userdata->object);
+    }
 
     bool is_type(Type p_t) const {
         switch (p_t) {
@@ -237,7 +292,7 @@ public:
     };
     bool is_type(UserdataType p_t) const {
         if (!is_type(USERDATA)) return false;
-        return userdata->get_userdata_type() == p_t;
+        return get_userdata_base()->get_userdata_type() == p_t;
     };
 
     void push(lua_State *p_L);
@@ -251,7 +306,35 @@ public:
         return type == LOCAL or type == REF;
     }
     bool can_cross_state_boundary() const;
+    // Reference to the value at p_idx that does not keep it alive, for caches on the native side.
+    // Values the GC never collects are converted as usual.
+    static LuaObject weak_ref(lua_State *p_L, int p_idx);
+    bool is_weak_ref() const;
+    // The referenced value as a strong object, nil once it has been collected.
+    LuaObject lock_weak(lua_State *p_L) const;
     LuaObject clone_in(LuauState* state) const;
+    // Primitives, strings and frozen tables holding only those, the same in every state.
+    bool is_immutable() const;
+    // is_immutable, and seals the tables found so they can not be unfrozen anymore.
+    // Required before handing them to other states or threads.
+    bool seal() const;
+
+    // Godot interop, defined in variant.cpp. Packed byte arrays become buffers aliasing the array,
+    // arrays, dictionaries and other packed arrays become tables.
+    static LuaObject from_variant(const ::godot::Variant& p_var);
+    ::godot::Variant to_variant() const;
+    // Like clone/clone_in, but immutable values are sealed and shared instead of copied.
+    // Values that can not be cloned are returned as is.
+    GDRBLX_INLINE LuaObject clone_or_share() const {
+        if (seal() || !can_clone())
+            return *this;
+        return clone();
+    }
+    GDRBLX_INLINE LuaObject share_in(LuauState* state) const {
+        if (seal() || !can_clone())
+            return *this;
+        return clone_in(state);
+    }
     bool knows_luau_state() const;
     LuauState* get_luau_state() const;
 
@@ -292,7 +375,21 @@ public:
 
     LuaObject operator [](const LuaObject& p_key  ) const;
 
-    LuaObject&  operator  =(const LuaObject& p_other) &;
+    // The old value is released last, p_other may be owned by it.
+    GDRBLX_INLINE LuaObject& operator =(const LuaObject& p_other) & {
+        if (this == &p_other)
+            return *this;
+        LuaObject old(std::move(*this));
+        new (this) LuaObject(p_other);
+        return *this;
+    }
+    GDRBLX_INLINE LuaObject& operator =(LuaObject&& p_other) & {
+        if (this == &p_other)
+            return *this;
+        LuaObject old(std::move(*this));
+        new (this) LuaObject(std::move(p_other));
+        return *this;
+    }
     LuaObject&  operator [](const LuaObject& p_key  );
 
     void rawset(const LuaObject& p_key, const LuaObject& p_value);
@@ -309,13 +406,26 @@ public:
     template <typename... Args>
     Vec<LuaObject> method_call_v(const LuauCtx& ctx, Args... p_args) const;
 
-    uint32_t hash() const;
+    // Strings reuse the hash cached in their shared storage, so repeated table lookups hash once.
+    GDRBLX_INLINE uint32_t hash() const {
+        if (type == STRING) {
+            uint32_t h = str->hash.load(std::memory_order_relaxed);
+            if (h == 0) {
+                h = internal::lua_string_hash(str->data, str->len);
+                str->hash.store(h, std::memory_order_relaxed);
+            }
+            return h;
+        }
+        return hash_slow();
+    }
 
     GDRBLX_INLINE bool is_null() const { return get_type() == NIL; }
 
     void close();
 }; // class LuaObject
 
+static_assert(sizeof(LuaObject) == 16, "LuaObject must stay 16 bytes.");
+
 static const LuaObject NIL_OBJECT_REF = LuaObject();
 
 class LuaObjectHasher {
@@ -1,9 +1,13 @@
 #ifndef OBJECT_HEADER_HPP
 #define OBJECT_HEADER_HPP
 
-#include <godot_cpp/core/safe_refcount.hpp>
+#include <atomic>
+#include <new>
+#include <utility>
 
 #include "macros.hpp"
+#include "slab_pool.hpp"
+#include "biased_refcount.hpp"
 #include "object.hpp"
 #include "buffer.hpp"
 #include "function.hpp"
@@ -24,14 +28,16 @@ class LuaObjectHeader {
         struct {
             LuauState* ref_owner;
             size_t ref_pos;
+            const void* ref_identity; // lua_topointer of the value, taken on the owner thread when the ref is made.
         };
     };
-    ::godot::SafeRefCount ref_count;
+    BiasedRefCount ref_count; // plain increments on the creating thread.
     enum {
         TYPE_BUF,
         TYPE_FUNC,
         TYPE_TBL,
-        TYPE_REF
+        TYPE_REF,
+        TYPE_WEAK_REF // slot in the state's weak reference table.
     } type;
 
     GDRBLX_INLINE LuaObjectHeader(const LuaBuffer& p_b) : b(p_b), type(TYPE_BUF) {
@@ -43,59 +49,77 @@ class LuaObjectHeader {
     GDRBLX_INLINE LuaObjectHeader(const LuaTable& p_t) : t(p_t), type(TYPE_TBL) {
         ref_count.init();
     }
-    GDRBLX_INLINE LuaObjectHeader(LuauState* p_ref_owner, size_t p_ref_pos) : ref_pos(p_ref_pos), ref_owner(p_ref_owner), type(TYPE_REF) {
+    GDRBLX_INLINE LuaObjectHeader(LuauState* p_ref_owner, size_t p_ref_pos, const void* p_identity, bool p_weak = false) : ref_owner(p_ref_owner), ref_pos(p_ref_pos), ref_identity(p_identity), type(p_weak ? TYPE_WEAK_REF : TYPE_REF) {
         ref_count.init();
     };
     GDRBLX_INLINE ~LuaObjectHeader() {
         switch (type) {
-            TYPE_BUF:
+            case TYPE_BUF:
                 b.~LuaBuffer();
                 break;
-            TYPE_FUNC:
+            case TYPE_FUNC:
                 f.~LuaFunction();
                 break;
-            TYPE_TBL:
+            case TYPE_TBL:
                 t.~LuaTable();
                 break;
-            TYPE_REF:
+            case TYPE_REF:
                 LuaObject::set_ref_to_nil(ref_owner, ref_pos);
                 break;
+            case TYPE_WEAK_REF:
+                LuaObject::set_weak_ref_to_nil(ref_owner, ref_pos);
+                break;
         }
     }
 
     GDRBLX_INLINE LuaObject::Type get_type() const {
         switch (type) {
-            TYPE_BUF:
+            case TYPE_BUF:
                 return LuaObject::BUFFER;
-            TYPE_FUNC:
+            case TYPE_FUNC:
                 return LuaObject::FUNCTION;
-            TYPE_TBL:
+            case TYPE_TBL:
                 return LuaObject::TABLE;
-            TYPE_REF:
+            case TYPE_REF:
                 return LuaObject::get_type_from_ref(ref_owner, ref_pos);
+            case TYPE_WEAK_REF:
+                return LuaObject::get_type_from_weak_ref(ref_owner, ref_pos);
         }
     }
 
     GDRBLX_INLINE LuaObject::Type get_header_type() const {
         switch (type) {
-            TYPE_BUF:
+            case TYPE_BUF:
                 return LuaObject::BUFFER;
-            TYPE_FUNC:
+            case TYPE_FUNC:
                 return LuaObject::FUNCTION;
-            TYPE_TBL:
+            case TYPE_TBL:
                 return LuaObject::TABLE;
-            TYPE_REF:
+            case TYPE_REF:
+            case TYPE_WEAK_REF:
                 return LuaObject::REF;
         }
     }
 
+    // Headers come from a per thread slab pool, never memnew them.
+    template <typename... Args>
+    GDRBLX_INLINE static LuaObjectHeader* create(Args&&... p_args) {
+        return new (SlabPool<LuaObjectHeader>::allocate()) LuaObjectHeader(std::forward<Args>(p_args)...);
+    }
+
     GDRBLX_INLINE void incref() {
         ref_count.ref();
     }
 
+    GDRBLX_INLINE static void destroy(void *p_header) {
+        LuaObjectHeader *header = (LuaObjectHeader*)p_header;
+        header->~LuaObjectHeader();
+        SlabPool<LuaObjectHeader>::release(header);
+    }
+
     GDRBLX_INLINE void decref() {
-        if (ref_count.unref()) 
-            ::godot::memdelete(this);
+        if (ref_count.unref(this, destroy))
+            destroy(this);
     }
 };
 
@@ -0,0 +1,170 @@
+#ifndef REF_POOL_HPP
+#define REF_POOL_HPP
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+
+#include <lua.h>
+
+#include <godot_cpp/templates/local_vector.hpp>
+
+#include "macros.hpp"
+
+namespace gdrblx {
+
+// Registry slots of one LuauState, owned by REF objects.
+// Slots come from lua_ref once and are reused through a free list afterwards.
+// Releases may come from any thread or from inside the GC, so they are only queued
+// and cleared in one batch by flush(). LuauState flushes once FLUSH_THRESHOLD releases
+// are pending when a new slot is taken, and the scheduler at the end of frame_step.
+class LuaRefPool final {
+    ::godot::LocalVector<int> free_slots;
+    ::godot::LocalVector<int> pending_release;
+    std::atomic<uint32_t> pending_count = 0;
+    std::mutex lock;
+public:
+    static constexpr uint32_t FLUSH_THRESHOLD = 64;
+
+    // Stores the value at p_idx and returns its slot.
+    int acquire(lua_State *L, int p_idx) {
+        int slot = -1;
+        {
+            std::lock_guard guard(lock);
+            if (!free_slots.is_empty()) {
+                slot = free_slots[free_slots.size() - 1];
+                free_slots.resize(free_slots.size() - 1);
+            }
+        }
+        if (slot == -1)
+            return lua_ref(L, p_idx);
+        lua_pushvalue(L, p_idx);
+        lua_rawseti(L, LUA_REGISTRYINDEX, slot);
+        return slot;
+    }
+    GDRBLX_INLINE static void push(lua_State *L, int p_slot) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, p_slot);
+    }
+    // Safe from any thread, the slot keeps its value until the next flush.
+    GDRBLX_INLINE void release(int p_slot) {
+        std::lock_guard guard(lock);
+        pending_release.push_back(p_slot);
+        pending_count.store(pending_release.size(), std::memory_order_relaxed);
+    }
+    // Lock free hint for the acquiring thread.
+    GDRBLX_INLINE bool needs_flush() const {
+        return pending_count.load(std::memory_order_relaxed) >= FLUSH_THRESHOLD;
+    }
+    // Clears the queued slots and makes them available again, from the thread owning L.
+    void flush(lua_State *L) {
+        ::godot::LocalVector<int> released;
+        {
+            std::lock_guard guard(lock);
+            if (pending_release.is_empty())
+                return;
+            std::swap(released, pending_release);
+            pending_count.store(0, std::memory_order_relaxed);
+        }
+        for (int slot : released) {
+            lua_pushnil(L);
+            lua_rawseti(L, LUA_REGISTRYINDEX, slot);
+        }
+        std::lock_guard guard(lock);
+        for (int slot : released)
+            free_slots.push_back(slot);
+    }
+    GDRBLX_INLINE size_t get_pending_count() {
+        std::lock_guard guard(lock);
+        return pending_release.size();
+    }
+}; // class LuaRefPool
+
+// Slots in a weak valued table kept in the registry, they do not keep their values alive
+// and read as nil once the GC collected the value. Releases are queued like LuaRefPool's,
+// and either pool reaching the threshold flushes both.
+class LuaWeakRefPool final {
+    ::godot::LocalVector<int> free_slots;
+    ::godot::LocalVector<int> pending_release;
+    std::atomic<uint32_t> pending_count = 0;
+    std::mutex lock;
+    int table_ref = LUA_NOREF;
+    int next_slot = 1;
+
+    void push_table(lua_State *L) {
+        if (table_ref != LUA_NOREF) {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, table_ref);
+            return;
+        }
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushstring(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        table_ref = lua_ref(L, -1);
+    }
+public:
+    // Stores the value at p_idx without pinning it and returns its slot.
+    int acquire(lua_State *L, int p_idx) {
+        p_idx = lua_absindex(L, p_idx);
+        int slot;
+        {
+            std::lock_guard guard(lock);
+            if (!free_slots.is_empty()) {
+                slot = free_slots[free_slots.size() - 1];
+                free_slots.resize(free_slots.size() - 1);
+            } else {
+                slot = next_slot++;
+            }
+        }
+        push_table(L);
+        lua_pushvalue(L, p_idx);
+        lua_rawseti(L, -2, slot);
+        lua_pop(L, 1);
+        return slot;
+    }
+    // Pushes the value, or nil if it has been collected.
+    GDRBLX_INLINE void push(lua_State *L, int p_slot) const {
+        if (table_ref == LUA_NOREF) {
+            lua_pushnil(L);
+            return;
+        }
+        lua_rawgeti(L, LUA_REGISTRYINDEX, table_ref);
+        lua_rawgeti(L, -1, p_slot);
+        lua_remove(L, -2);
+    }
+    GDRBLX_INLINE void release(int p_slot) {
+        std::lock_guard guard(lock);
+        pending_release.push_back(p_slot);
+        pending_count.store(pending_release.size(), std::memory_order_relaxed);
+    }
+    GDRBLX_INLINE bool needs_flush() const {
+        return pending_count.load(std::memory_order_relaxed) >= LuaRefPool::FLUSH_THRESHOLD;
+    }
+    void flush(lua_State *L) {
+        ::godot::LocalVector<int> released;
+        {
+            std::lock_guard guard(lock);
+            if (pending_release.is_empty())
+                return;
+            std::swap(released, pending_release);
+            pending_count.store(0, std::memory_order_relaxed);
+        }
+        push_table(L);
+        for (int slot : released) {
+            lua_pushnil(L);
+            lua_rawseti(L, -2, slot);
+        }
+        lua_pop(L, 1);
+        std::lock_guard guard(lock);
+        for (int slot : released)
+            free_slots.push_back(slot);
+    }
+    GDRBLX_INLINE size_t get_pending_count() {
+        std::lock_guard guard(lock);
+        return pending_release.size();
+    }
+}; // class LuaWeakRefPool
+
+} // namespace gdrblx
+
+#endif // REF_POOL_HPP
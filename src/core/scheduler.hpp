@@ -8,6 +8,8 @@
 #include "thread.hpp"
 #include "state.hpp"
 #include "lua_tuple.hpp"
+#include "biased_refcount.hpp"
+#include "epoch.hpp"
 
 namespace gdrblx {
 
@@ -32,6 +34,14 @@ protected:
         LuaTable wait;
     } threads_pending[2];
     bool defer_resume(); // true if there are more to resume.
+    // Clears the registry slots released since the last frame and applies the object
+    // releases other threads queued for this one, run at the end of frame_step.
+    // Registry slots are also flushed by LuauState::ref() once enough are pending.
+    GDRBLX_INLINE void release_refs() {
+        assigned_state->flush_refs();
+        internal::BiasedRefOwner::process_current();
+        internal::EpochDomain::collect();
+    }
 public:
     static int lua_spawn(lua_State *L);
     static int lua_defer(lua_State *L);
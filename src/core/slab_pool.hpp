@@ -0,0 +1,117 @@
+#ifndef SLAB_POOL_HPP
+#define SLAB_POOL_HPP
+
+#include <mutex>
+
+#include <godot_cpp/core/memory.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#include "macros.hpp"
+
+namespace gdrblx {
+
+namespace internal {
+
+// Fixed size allocator for small, frequently created objects like LuaObjectHeader.
+// Each thread keeps a free list, refilled from and spilled to a shared depot one batch at a time,
+// so the depot lock is taken once per BATCH_SIZE allocations. Slabs are never returned to the OS.
+template <typename T>
+class SlabPool final {
+    static constexpr size_t SLOT_SIZE = sizeof(T) > sizeof(void*) ? sizeof(T) : sizeof(void*);
+    static constexpr size_t SLAB_SLOTS = 64;
+    static constexpr size_t BATCH_SIZE = 64;
+    static constexpr size_t MAX_CACHED = BATCH_SIZE * 4; // per thread
+
+    struct FreeSlot {
+        FreeSlot *next;
+    };
+    struct Batch {
+        FreeSlot *head = nullptr;
+        size_t count = 0;
+    };
+
+    struct Depot {
+        ::godot::LocalVector<Batch> batches;
+        ::godot::LocalVector<void*> slabs;
+        std::mutex lock;
+        ~Depot() {
+            for (void *slab : slabs)
+                memfree(slab);
+        }
+    };
+    GDRBLX_INLINE static Depot& get_depot() {
+        static Depot depot;
+        return depot;
+    }
+
+    struct Cache {
+        Batch local;
+        ~Cache() { // thread exit, hand everything back.
+            while (local.count > 0)
+                give_batch(local);
+        }
+    };
+    GDRBLX_INLINE static Cache& get_cache() {
+        thread_local Cache cache;
+        return cache;
+    }
+
+    // Moves up to BATCH_SIZE slots from p_from to the depot.
+    static void give_batch(Batch& p_from) {
+        Batch batch;
+        while (batch.count < BATCH_SIZE && p_from.head != nullptr) {
+            FreeSlot *s = p_from.head;
+            p_from.head = s->next;
+            s->next = batch.head;
+            batch.head = s;
+            batch.count++;
+        }
+        p_from.count -= batch.count;
+        Depot& depot = get_depot();
+        std::lock_guard guard(depot.lock);
+        depot.batches.push_back(batch);
+    }
+    static void refill(Batch& p_into) {
+        Depot& depot = get_depot();
+        std::lock_guard guard(depot.lock);
+        if (!depot.batches.is_empty()) {
+            p_into = depot.batches[depot.batches.size() - 1];
+            depot.batches.resize(depot.batches.size() - 1);
+            return;
+        }
+        uint8_t *slab = (uint8_t*)memalloc(SLOT_SIZE * SLAB_SLOTS);
+        depot.slabs.push_back(slab);
+        for (size_t i = SLAB_SLOTS; i > 0; i--) {
+            FreeSlot *s = (FreeSlot*)(slab + (i - 1) * SLOT_SIZE);
+            s->next = p_into.head;
+            p_into.head = s;
+        }
+        p_into.count = SLAB_SLOTS;
+    }
+public:
+    GDRBLX_INLINE static void* allocate() {
+        Batch& local = get_cache().local;
+        if (unlikely(local.head == nullptr))
+            refill(local);
+        FreeSlot *s = local.head;
+        local.head = s->next;
+        local.count--;
+        return s;
+    }
+    // Any thread may release, the slot joins that thread's free list.
+    GDRBLX_INLINE static void release(void *p_ptr) {
+        Batch& local = get_cache().local;
+        FreeSlot *s = (FreeSlot*)p_ptr;
+        s->next = local.head;
+        local.head = s;
+        local.count++;
+        if (unlikely(local.count > MAX_CACHED))
+            give_batch(local);
+    }
+}; // class SlabPool
+
+} // namespace internal
+
+} // namespace gdrblx
+
+#endif // SLAB_POOL_HPP
@@ -0,0 +1,81 @@
+#ifndef STACK_VIEW_HPP
+#define STACK_VIEW_HPP
+
+#include <lua.h>
+
+#include "macros.hpp"
+#include "object.hpp"
+
+namespace gdrblx {
+
+// Non owning view over a contiguous range of Lua stack slots.
+// Indexing creates locals, nothing is copied off the stack.
+class LuaStackView {
+    friend class LuauCtx;
+protected:
+    lua_State *L = nullptr;
+    int base = 0;
+    int count = 0;
+public:
+    GDRBLX_INLINE LuaStackView() {}
+    GDRBLX_INLINE LuaStackView(lua_State *p_L, int p_base, int p_count) : L(p_L), base(p_base), count(p_count) {}
+
+    GDRBLX_INLINE int size() const { return count; }
+    GDRBLX_INLINE bool is_empty() const { return count == 0; }
+    GDRBLX_INLINE lua_State *get_lua_state() const { return L; }
+    // Absolute stack index of the first slot.
+    GDRBLX_INLINE int get_base() const { return base; }
+
+    GDRBLX_INLINE LuaObject operator[](int p_idx) const {
+        DEV_ASSERT(p_idx >= 1 && p_idx <= count);
+        return LuaObject(L, base + p_idx - 1);
+    }
+    GDRBLX_INLINE LuaObject get(int p_idx) const {
+        return (*this)[p_idx];
+    }
+    // Converts the slot into an owned object, use when it has to outlive the view.
+    GDRBLX_INLINE LuaObject take(int p_idx) const {
+        DEV_ASSERT(p_idx >= 1 && p_idx <= count);
+        return LuaObject::convert(L, base + p_idx - 1);
+    }
+    GDRBLX_INLINE LuaStackView sub(int p_from, int p_count) const {
+        DEV_ASSERT(p_from >= 1 && p_from + p_count - 1 <= count);
+        return LuaStackView(L, base + p_from - 1, p_count);
+    }
+}; // class LuaStackView
+
+// Results of call_view/pcall_view/resume_view, left on the stack they were returned on.
+// Pops them when destroyed, so it must be the topmost thing on that stack by then.
+class LuaStackResults final : public LuaStackView {
+    friend class LuauCtx;
+    int status = LUA_OK;
+
+    GDRBLX_INLINE LuaStackResults(lua_State *p_L, int p_base, int p_count, int p_status) : LuaStackView(p_L, p_base, p_count), status(p_status) {}
+public:
+    LuaStackResults(const LuaStackResults&) = delete;
+    LuaStackResults& operator=(const LuaStackResults&) = delete;
+    GDRBLX_INLINE LuaStackResults(LuaStackResults&& p_other) : LuaStackView(p_other.L, p_other.base, p_other.count), status(p_other.status) {
+        p_other.L = nullptr;
+    }
+    GDRBLX_INLINE ~LuaStackResults() {
+        if (L != nullptr)
+            lua_settop(L, base - 1);
+    }
+
+    GDRBLX_INLINE int get_status() const { return status; }
+    GDRBLX_INLINE bool is_ok() const { return status == LUA_OK || status == LUA_YIELD; }
+    GDRBLX_INLINE bool is_err() const { return !is_ok(); }
+    GDRBLX_INLINE LuaObject get_error() const {
+        DEV_ASSERT(is_err());
+        return (*this)[count];
+    }
+    // Keeps the results on the stack, e.g. when returning them from a C function.
+    GDRBLX_INLINE int release() {
+        L = nullptr;
+        return count;
+    }
+}; // class LuaStackResults
+
+} // namespace gdrblx
+
+#endif // STACK_VIEW_HPP
@@ -0,0 +1,86 @@
+#include "state.hpp"
+
+#include <vm.hpp>
+
+#include "module_cache.hpp"
+#include "native_coroutine.hpp"
+
+namespace gdrblx {
+
+static void* state_alloc(void *, void *p_ptr, size_t, size_t p_nsize) {
+    if (p_nsize == 0) {
+        if (p_ptr != nullptr)
+            memfree(p_ptr);
+        return nullptr;
+    }
+    return memrealloc(p_ptr, p_nsize);
+}
+
+LuauState::LuauState(RobloxVM* p_vm, TaskScheduler* p_scheduler, Bare) : vm(p_vm), scheduler(p_scheduler), callbacks(nullptr), L(lua_newstate(&state_alloc, nullptr)) {
+    callbacks = lua_callbacks(L);
+    callbacks->userdata = this;
+    callbacks->userthread = &userthread_callback;
+    lua_pushlightuserdata(L, this); // the template skips light userdata.
+    lua_setfield(L, LUA_REGISTRYINDEX, "luau_state");
+    attach_main_thread();
+}
+
+void LuauState::attach_main_thread() {
+    main_thread_data.state = this;
+    main_thread_data.actor = actor_instance.exists ? &actor_instance.unwrap().unsafe_access() : nullptr;
+    lua_setthreaddata(L, &main_thread_data);
+}
+
+void LuauState::userthread(lua_State *LP, lua_State *L) {
+    if (LP != nullptr) { // created
+        internal::LuauThreadData* parent = get_thread_data(LP);
+        internal::LuauThreadData* data = memnew(internal::LuauThreadData);
+        data->state = this;
+        data->actor = actor_instance.exists ? &actor_instance.unwrap().unsafe_access() : nullptr;
+        if (parent != nullptr) { // coroutines inherit the identity and script of their creator.
+            data->identity = parent->identity;
+            data->script = parent->script;
+        }
+        lua_setthreaddata(L, data);
+    } else { // destroyed
+        internal::LuauThreadData* data = get_thread_data(L);
+        lua_setthreaddata(L, nullptr);
+        if (data != nullptr && data != &main_thread_data) {
+            // the script and the frame may release refs or run destructors, not from inside the GC.
+            std::lock_guard guard(dead_threads_lock);
+            dead_threads.push_back(data);
+        }
+    }
+}
+
+void LuauState::userthread_callback(lua_State *LP, lua_State *L) {
+    ((LuauState*)lua_callbacks(L)->userdata)->userthread(LP, L);
+}
+
+void LuauState::release_dead_threads() {
+    LocalVec<internal::LuauThreadData*> dead;
+    {
+        std::lock_guard guard(dead_threads_lock);
+        if (dead_threads.is_empty())
+            return;
+        std::swap(dead, dead_threads);
+    }
+    for (internal::LuauThreadData* data : dead) {
+        internal::release_native_frames(data, nullptr); // closed while suspended, or after an error.
+        ::godot::memdelete(data);
+    }
+}
+
+LuauState::~LuauState() {
+    vm->modules.release_state(this); // a later state may be allocated at the same address.
+    stringf = LuaObject(); // holds a ref, released while the pool is still around.
+    internal::release_native_frames(&main_thread_data, nullptr); // left behind by errors.
+    lua_close(L);
+    release_dead_threads();
+}
+
+void LuauState::open_libs() {
+    ModuleCache::open(this);
+}
+
+} // namespace gdrblx
@@ -1,22 +1,28 @@
 #ifndef STATE_HPP
 #define STATE_HPP
 
+#include <mutex>
+
 #include <lua.h>
 
 #include <godot_cpp/classes/rw_lock.hpp>
 
 #include "object.hpp"
 #include "thread.hpp"
+#include "ref_pool.hpp"
 
 namespace gdrblx {
 
 class TaskScheduler;
 class RobloxVM;
 class Actor;
+class LuauStateTemplate;
 
 class LuauState final {
     friend class LuaObject;
     friend class TaskScheduler;
+    friend class LuauStateTemplate;
+    friend class LuaThread;
 
     RobloxVM *const vm;
     TaskScheduler *const scheduler;
@@ -28,11 +34,39 @@ class LuauState final {
 
     Option<Arc<Actor>> actor_instance = nullptr;
 
+    LuaRefPool refs;
+    LuaWeakRefPool weak_refs;
+
+    // Thread data of L, userthread only runs for the coroutines.
+    internal::LuauThreadData main_thread_data;
+    // Thread data of collected coroutines, released by flush_refs outside of the GC.
+    LocalVec<internal::LuauThreadData*> dead_threads;
+    std::mutex dead_threads_lock;
+
     ::godot::RWLock rwlock;
+    // Full initialization sequence. Its body is not part of this tree, it has to delegate to
+    // the bare constructor too so coroutines get thread data, then run open_libs.
     LuauState(RobloxVM* p_vm, TaskScheduler* p_scheduler);
+    struct Bare {};
+    // Only lua_newstate and the callbacks (userthread included) and the main thread data,
+    // no libraries or globals.
+    LuauState(RobloxVM* p_vm, TaskScheduler* p_scheduler, Bare);
+    // Bare state filled from a snapshot, skips the initialization sequence.
+    GDRBLX_INLINE LuauState(RobloxVM* p_vm, TaskScheduler* p_scheduler, const LuauStateTemplate& p_template) : LuauState(p_vm, p_scheduler, Bare()) {
+        apply_template(p_template);
+    }
+    void apply_template(const LuauStateTemplate& p_template);
+    // Globals implemented by the engine itself (require), run by apply_template.
+    void open_libs();
+    // Run by the bare constructor right after the state is created, before any script runs.
+    void attach_main_thread();
+    // Also run by the destructor, after lua_close collected the remaining coroutines.
+    void release_dead_threads();
     LuaThread create_thread();
 
     void userthread(lua_State *LP, lua_State *L);
+    // lua_Callbacks::userthread, the state is the callbacks' userdata.
+    static void userthread_callback(lua_State *LP, lua_State *L);
     
 
 public:
@@ -41,6 +75,21 @@ public:
 
     LuaThread create_thread(LuaFunction p_func);
 
+    GDRBLX_INLINE static internal::LuauThreadData* get_thread_data(lua_State *p_L) {
+        return (internal::LuauThreadData*)lua_getthreaddata(p_L);
+    }
+    // O(1) for the main thread and every coroutine created through userthread,
+    // the registry is only a fallback for threads made before attach_main_thread.
+    GDRBLX_INLINE static LuauState* from_lua_state(lua_State *p_L) {
+        internal::LuauThreadData* data = get_thread_data(p_L);
+        if (data != nullptr)
+            return data->state;
+        lua_getfield(p_L, LUA_REGISTRYINDEX, "luau_state");
+        LuauState* state = (LuauState*)lua_tolightuserdata(p_L, -1);
+        lua_pop(p_L, 1);
+        return state;
+    }
+
     GDRBLX_INLINE TaskScheduler* get_scheduler() { return scheduler; }
     GDRBLX_INLINE RobloxVM* get_vm() { return vm; }
     GDRBLX_INLINE const LuaObject& get_stringf() { return stringf; }
@@ -49,6 +98,32 @@ public:
 
     bool synchronized() const;
 
+    // Registry slot for the value at p_idx of p_L, a thread of this state.
+    // Also where released slots get cleared once enough piled up, without waiting for the frame end.
+    GDRBLX_INLINE int ref(lua_State *p_L, int p_idx) {
+        if (refs.needs_flush() || weak_refs.needs_flush())
+            flush_refs(p_L);
+        return refs.acquire(p_L, p_idx);
+    }
+    GDRBLX_INLINE void push_ref(lua_State *p_L, int p_ref) const { LuaRefPool::push(p_L, p_ref); }
+    // Deferred until the next flush, callable from any thread.
+    GDRBLX_INLINE void unref(int p_ref) { refs.release(p_ref); }
+    // Slot in the weak reference table, the value may be collected while it is held.
+    GDRBLX_INLINE int weak_ref(lua_State *p_L, int p_idx) {
+        if (refs.needs_flush() || weak_refs.needs_flush())
+            flush_refs(p_L);
+        return weak_refs.acquire(p_L, p_idx);
+    }
+    GDRBLX_INLINE void push_weak_ref(lua_State *p_L, int p_ref) const { weak_refs.push(p_L, p_ref); }
+    GDRBLX_INLINE void unref_weak(int p_ref) { weak_refs.release(p_ref); }
+    // From a thread of this state, by the scheduler at the end of frame_step and from ref().
+    GDRBLX_INLINE void flush_refs(lua_State *p_L) {
+        release_dead_threads(); // their scripts release refs too.
+        refs.flush(p_L);
+        weak_refs.flush(p_L);
+    }
+    GDRBLX_INLINE void flush_refs() { flush_refs(L); }
+
     void raise_oom_error() const;
 };
 
@@ -0,0 +1,201 @@
+#include "state_template.hpp"
+
+#include "context.hpp"
+#include "state.hpp"
+
+namespace gdrblx {
+
+// Converts the value at p_idx, false if it is bound to the source state.
+bool LuauStateTemplate::capture(lua_State *L, int p_idx, Visited& r_visited, LuaObject& r_value) {
+    switch (lua_type(L, p_idx)) {
+        case LUA_TTABLE: {
+            const void *ptr = lua_topointer(L, p_idx);
+            if (LuaObject *seen = r_visited.getptr(ptr)) {
+                r_value = *seen;
+                return true;
+            }
+            r_value = LuaObject(LuaTable());
+            r_visited.insert(ptr, r_value); // before the contents, they may point back.
+            capture_table(L, p_idx, r_visited, (LuaTable&)r_value, false);
+            return true;
+        }
+        case LUA_TFUNCTION: {
+            if (!lua_iscfunction(L, p_idx))
+                return false;
+            if (lua_getupvalue(L, p_idx, 1) == nullptr)
+                break; // plain C function, converted as usual.
+            lua_pop(L, 1);
+            const void *ptr = lua_topointer(L, p_idx);
+            if (LuaObject *seen = r_visited.getptr(ptr)) {
+                r_value = *seen;
+                return true;
+            }
+            const LuaObject local(L, p_idx);
+            lua_Debug ar = {};
+            lua_getinfo(L, p_idx - lua_gettop(L) - 1, "n", &ar);
+            Closure c{ (lua_CFunction)local, (lua_Continuation)local, ar.name != nullptr ? ar.name : "<C function>" };
+            r_value = LuaObject(LuaFunction(c.cfunc, c.name));
+            r_visited.insert(ptr, r_value);
+            for (int i = 1; lua_getupvalue(L, p_idx, i) != nullptr; i++) {
+                LuaObject up;
+                if (!capture(L, lua_gettop(L), r_visited, up)) {
+                    lua_pop(L, 1);
+                    r_visited.erase(ptr);
+                    return false;
+                }
+                c.upvalues.push_back(up);
+                lua_pop(L, 1);
+            }
+            closures.insert(&(const LuaFunction&)r_value, c);
+            return true;
+        }
+        case LUA_TLIGHTUSERDATA: // the state pointer must not leak into the copies.
+        case LUA_TTHREAD:
+            return false;
+        default:
+            break;
+    }
+    r_value = LuaObject::convert(L, p_idx);
+    if (r_value.can_clone())
+        r_value = r_value.clone();
+    return r_value.can_cross_state_boundary();
+}
+
+void LuauStateTemplate::capture_table(lua_State *L, int p_idx, Visited& r_visited, LuaTable& r_table, bool p_string_keys_only) {
+    p_idx = p_idx < 0 ? lua_gettop(L) + p_idx + 1 : p_idx;
+    lua_pushnil(L);
+    while (lua_next(L, p_idx) != 0) {
+        LuaObject k, v;
+        if (p_string_keys_only && lua_type(L, -2) != LUA_TSTRING) {
+            lua_pop(L, 1);
+            continue;
+        }
+        if (capture(L, lua_gettop(L) - 1, r_visited, k) && capture(L, lua_gettop(L), r_visited, v))
+            r_table.set(k, v);
+        else
+            skipped++;
+        lua_pop(L, 1);
+    }
+    if (!p_string_keys_only) { // the roots are filled in place.
+        TableInfo info;
+        info.readonly = lua_getreadonly(L, p_idx);
+        if (lua_getmetatable(L, p_idx)) {
+            if (!capture(L, lua_gettop(L), r_visited, info.metatable))
+                skipped++;
+            lua_pop(L, 1);
+        }
+        if (info.readonly || !info.metatable.is_type(LuaObject::NIL))
+            tables.insert(&r_table, info);
+    }
+    r_table.freeze();
+}
+
+LuauStateTemplate::LuauStateTemplate(LuauState* p_initialized) {
+    lua_State *L = p_initialized->L;
+    Visited visited;
+    globals = LuaObject(LuaTable());
+    registry = LuaObject(LuaTable());
+    visited.insert(lua_topointer(L, LUA_GLOBALSINDEX), globals);
+    visited.insert(lua_topointer(L, LUA_REGISTRYINDEX), registry);
+    capture_table(L, LUA_REGISTRYINDEX, visited, (LuaTable&)registry, true);
+    capture_table(L, LUA_GLOBALSINDEX, visited, (LuaTable&)globals, false);
+
+    lua_pushstring(L, "");
+    if (lua_getmetatable(L, -1)) {
+        if (!capture(L, lua_gettop(L), visited, string_metatable))
+            skipped++;
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+void LuauStateTemplate::fill_table(lua_State *L, int p_cache, int p_idx, const LuaTable& p_table) const {
+    p_table.foreach([this, L, p_cache, p_idx](const LuaObject& k, const LuaObject& v) {
+        push_value(L, p_cache, k);
+        push_value(L, p_cache, v);
+        lua_rawset(L, p_idx);
+    });
+}
+
+// Tables and closures go through p_cache, keyed by their native address, so each is pushed once.
+void LuauStateTemplate::push_value(lua_State *L, int p_cache, const LuaObject& p_value) const {
+    const LuaObject::Type type = p_value.get_type();
+    if (type != LuaObject::TABLE && type != LuaObject::FUNCTION) {
+        LuaObject(p_value).push(L);
+        return;
+    }
+    const void *key = type == LuaObject::TABLE ? (const void*)&(const LuaTable&)p_value : (const void*)&(const LuaFunction&)p_value;
+    lua_pushlightuserdata(L, (void*)key);
+    lua_rawget(L, p_cache);
+    if (!lua_isnil(L, -1))
+        return;
+    lua_pop(L, 1);
+
+    if (type == LuaObject::FUNCTION) {
+        const Closure *c = closures.getptr((const LuaFunction*)key);
+        if (c == nullptr) {
+            LuaObject(p_value).push(L);
+            return;
+        }
+        for (const LuaObject& up : c->upvalues)
+            push_value(L, p_cache, up);
+        lua_pushcclosurek(L, c->cfunc, c->name, (int)c->upvalues.size(), c->cont);
+        lua_pushlightuserdata(L, (void*)key);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, p_cache);
+        return;
+    }
+
+    const LuaTable& t = p_value;
+    lua_newtable(L);
+    const int idx = lua_gettop(L);
+    lua_pushlightuserdata(L, (void*)key);
+    lua_pushvalue(L, idx);
+    lua_rawset(L, p_cache);
+    fill_table(L, p_cache, idx, t);
+    if (const TableInfo *info = tables.getptr(&t)) {
+        if (!info->metatable.is_type(LuaObject::NIL)) {
+            push_value(L, p_cache, info->metatable);
+            lua_setmetatable(L, idx);
+        }
+        if (info->readonly) // once every field is in.
+            lua_setreadonly(L, idx, true);
+    }
+}
+
+void LuauStateTemplate::apply(LuauState* p_state) const {
+    lua_State *L = p_state->L;
+    lua_newtable(L);
+    const int cache = lua_gettop(L);
+    lua_pushlightuserdata(L, (void*)&(const LuaTable&)globals);
+    lua_pushvalue(L, LUA_GLOBALSINDEX);
+    lua_rawset(L, cache);
+    lua_pushlightuserdata(L, (void*)&(const LuaTable&)registry);
+    lua_pushvalue(L, LUA_REGISTRYINDEX);
+    lua_rawset(L, cache);
+
+    fill_table(L, cache, LUA_REGISTRYINDEX, (const LuaTable&)registry);
+    fill_table(L, cache, LUA_GLOBALSINDEX, (const LuaTable&)globals);
+    if (!string_metatable.is_type(LuaObject::NIL)) {
+        lua_pushstring(L, "");
+        push_value(L, cache, string_metatable);
+        lua_setmetatable(L, -2);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    LuauCtx ctx = L;
+    LuaObject g = ctx.globals;
+    p_state->stringf = g.rawget("string").rawget("format").clone_in(p_state);
+}
+
+void LuauState::apply_template(const LuauStateTemplate& p_template) {
+    p_template.apply(this);
+    open_libs(); // the initialization sequence is skipped for these.
+}
+
+LuauState* LuauStateTemplate::instantiate(RobloxVM* p_vm, TaskScheduler* p_scheduler) const {
+    return memnew(LuauState(p_vm, p_scheduler, *this));
+}
+
+} // namespace gdrblx
@@ -0,0 +1,62 @@
+#ifndef STATE_TEMPLATE_HPP
+#define STATE_TEMPLATE_HPP
+
+#include <lua.h>
+
+#include "macros.hpp"
+#include "object.hpp"
+#include "table.hpp"
+#include "string.hpp"
+
+namespace gdrblx {
+
+class LuauState;
+class RobloxVM;
+class TaskScheduler;
+
+// Snapshot of a fully initialized LuauState.
+// Globals, libraries and registry entries (userdata metatables) are stored natively,
+// new Actor states get them pushed instead of running the initialization sequence again.
+// Both roots are captured in one pass, a table reachable from several places
+// (_G and _LOADED._G, shared metatables, self references) is pushed once per state.
+// Immutable once built, can be instantiated from any thread.
+class LuauStateTemplate final {
+    friend class LuauState;
+
+    struct TableInfo {
+        LuaObject metatable;
+        bool readonly = false;
+    };
+    // C closures with upvalues, the table holds a placeholder function keyed here.
+    struct Closure {
+        lua_CFunction cfunc;
+        lua_Continuation cont;
+        LuaString name;
+        LocalVec<LuaObject> upvalues;
+    };
+    using Visited = HashMap<const void*, LuaObject>;
+
+    LuaObject globals;
+    LuaObject registry;
+    LuaObject string_metatable;
+    HashMap<const LuaTable*, TableInfo> tables;
+    HashMap<const LuaFunction*, Closure> closures;
+    size_t skipped = 0;
+
+    bool capture(lua_State *L, int p_idx, Visited& r_visited, LuaObject& r_value);
+    void capture_table(lua_State *L, int p_idx, Visited& r_visited, LuaTable& r_table, bool p_string_keys_only);
+    void push_value(lua_State *L, int p_cache, const LuaObject& p_value) const;
+    void fill_table(lua_State *L, int p_cache, int p_idx, const LuaTable& p_table) const;
+    void apply(LuauState* p_state) const;
+public:
+    explicit LuauStateTemplate(LuauState* p_initialized);
+
+    LuauState* instantiate(RobloxVM* p_vm, TaskScheduler* p_scheduler) const;
+
+    // Values bound to the source state (Lua closures, threads) which could not be captured.
+    GDRBLX_INLINE size_t get_skipped_count() const { return skipped; }
+}; // class LuauStateTemplate
+
+} // namespace gdrblx
+
+#endif // STATE_TEMPLATE_HPP
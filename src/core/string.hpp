@@ -1,84 +1,267 @@
 #ifndef STRING_HPP
 #define STRING_HPP
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <new>
+#include <utility>
 
 #include <godot_cpp/core/memory.hpp>
+#include <godot_cpp/core/safe_refcount.hpp>
 #include <godot_cpp/variant/string.hpp>
 #include <godot_cpp/variant/char_string.hpp>
 
 #include "macros.hpp"
+#include "hash.hpp"
 
 namespace gdrblx {
 
-class LuaString {
-public:
-    char *s;
-    int l;
-    LuaString(::godot::String p_s) {
-        ::godot::CharString c = p_s.ascii();
-        l = c.size();
-        this->s = (char*)memalloc((l+1)*sizeof(char));
-        if (c.ptr() == nullptr) {
-            this->s[0] = '\0';
-        } else {
-            memcpy(this->s,c.ptr(),(l+1)*sizeof(char));
-        }
+namespace internal {
+
+// Shared, refcounted storage of long strings. Also what LuaObject holds for STRING values.
+struct LuaStringData {
+    ::godot::SafeRefCount ref_count;
+    // 0 when not computed yet. Relaxed, threads racing to fill it in store the same value.
+    mutable std::atomic<uint32_t> hash;
+    int len : 31;
+    bool interned : 1; // owned by a LuaStringPool, equal contents interned by one VM share the same block.
+    uint32_t pool; // id of that pool.
+    char data[1];
+
+    GDRBLX_INLINE static LuaStringData* create(const char *p_str, size_t p_len) {
+        LuaStringData *d = (LuaStringData*)memalloc(sizeof(LuaStringData) + p_len);
+        d->ref_count.init();
+        new (&d->hash) std::atomic<uint32_t>(0);
+        d->len = (int)p_len;
+        d->interned = false;
+        d->pool = 0;
+        if (p_str != nullptr)
+            memcpy(d->data, p_str, p_len);
+        d->data[p_len] = '\0';
+        return d;
+    }
+    GDRBLX_INLINE void incref() {
+        ref_count.ref();
+    }
+    GDRBLX_INLINE void decref() {
+        if (ref_count.unref())
+            memfree(this);
     }
-    LuaString() {
-        s = nullptr;
-        l = 0;
+};
+
+GDRBLX_INLINE uint32_t lua_string_hash(const char *p_str, size_t p_len) {
+    return hash_bytes(p_str, p_len); // never 0, which marks a hash that was not computed.
+}
+
+GDRBLX_INLINE size_t utf8_length(char32_t p_c) {
+    if (p_c < 0x80)
+        return 1;
+    if (p_c < 0x800)
+        return 2;
+    if (p_c < 0x10000)
+        return 3;
+    if (p_c < 0x110000)
+        return 4;
+    return 3; // encoded as U+FFFD
+}
+GDRBLX_INLINE size_t utf8_encode(char32_t p_c, char *r_dst) {
+    if (p_c < 0x80) {
+        r_dst[0] = (char)p_c;
+        return 1;
     }
-    LuaString(std::nullptr_t) {
-        s = nullptr;
-        l = 0;
+    if (p_c < 0x800) {
+        r_dst[0] = (char)(0xC0 | (p_c >> 6));
+        r_dst[1] = (char)(0x80 | (p_c & 0x3F));
+        return 2;
     }
-    explicit LuaString(int p_len) {
-        l = p_len;
-        s = (char*)memalloc((l+1)*sizeof(char));
+    if (p_c >= 0x110000)
+        p_c = 0xFFFD;
+    if (p_c < 0x10000) {
+        r_dst[0] = (char)(0xE0 | (p_c >> 12));
+        r_dst[1] = (char)(0x80 | ((p_c >> 6) & 0x3F));
+        r_dst[2] = (char)(0x80 | (p_c & 0x3F));
+        return 3;
     }
-    LuaString(const char* p_cs) {
-        auto slen = strlen(p_cs);
-        l = slen;
-        s = (char*)memalloc((l+1)*sizeof(char));
-        if (p_cs == nullptr) {
-            s[0] = 0;
+    r_dst[0] = (char)(0xF0 | (p_c >> 18));
+    r_dst[1] = (char)(0x80 | ((p_c >> 12) & 0x3F));
+    r_dst[2] = (char)(0x80 | ((p_c >> 6) & 0x3F));
+    r_dst[3] = (char)(0x80 | (p_c & 0x3F));
+    return 4;
+}
+GDRBLX_INLINE size_t utf8_length(const ::godot::String& p_s) {
+    const char32_t *src = p_s.ptr();
+    const int64_t n = p_s.length();
+    size_t len = 0;
+    for (int64_t i = 0; i < n; i++)
+        len += utf8_length(src[i]);
+    return len;
+}
+// r_dst must hold utf8_length(p_s) bytes.
+GDRBLX_INLINE void utf8_encode(const ::godot::String& p_s, char *r_dst) {
+    const char32_t *src = p_s.ptr();
+    const int64_t n = p_s.length();
+    for (int64_t i = 0; i < n; i++)
+        r_dst += utf8_encode(src[i], r_dst);
+}
+
+} // namespace internal
+
+// Strings up to SSO_CAPACITY bytes are stored inline, longer ones share a refcounted LuaStringData.
+// `s` and `l` stay public for reading, only write through `s` on a string you just created.
+class LuaString {
+    static constexpr int SSO_CAPACITY = 15;
+
+    union {
+        char inline_buf[SSO_CAPACITY + 1];
+        internal::LuaStringData *shared;
+    };
+    mutable std::atomic<uint32_t> cached_hash = 0; // relaxed, like LuaStringData::hash.
+
+    GDRBLX_INLINE bool is_inline() const {
+        return s == inline_buf;
+    }
+    GDRBLX_INLINE void init(const char *p_str, size_t p_len) {
+        l = (int)p_len;
+        if (p_len <= SSO_CAPACITY) {
+            s = inline_buf;
         } else {
-            strcpy(s, p_cs);
+            shared = internal::LuaStringData::create(nullptr, p_len);
+            s = shared->data;
         }
+        if (p_str != nullptr)
+            memcpy(s, p_str, p_len);
+        else if (p_len > 0)
+            s[0] = '\0';
+        s[p_len] = '\0';
     }
-    LuaString(const char* p_cs, size_t len) {
-        l = len;
-        s = (char*)memalloc((l+1)*sizeof(char));
-        if (p_cs == nullptr) {
-            s[0] = 0;
+    GDRBLX_INLINE void init_copy(const LuaString& p_o) {
+        l = p_o.l;
+        cached_hash.store(p_o.cached_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        if (p_o.s == nullptr) {
+            s = nullptr;
+            shared = nullptr;
+        } else if (p_o.is_inline()) {
+            memcpy(inline_buf, p_o.inline_buf, l + 1);
+            s = inline_buf;
         } else {
-            memcpy(s,p_cs,(l+1)*sizeof(char));
+            shared = p_o.shared;
+            shared->incref();
+            s = shared->data;
         }
     }
-    LuaString(const LuaString& p_o) {
+    GDRBLX_INLINE void init_move(LuaString& p_o) {
         l = p_o.l;
-        s = (char*)memalloc((l+1)*sizeof(char));
+        cached_hash.store(p_o.cached_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
         if (p_o.s == nullptr) {
-            s[0] = 0;
+            s = nullptr;
+            shared = nullptr;
+        } else if (p_o.is_inline()) {
+            memcpy(inline_buf, p_o.inline_buf, l + 1);
+            s = inline_buf;
         } else {
-            memcpy(s,p_o.s,(l+1)*sizeof(char));
+            shared = p_o.shared;
+            s = shared->data;
+            p_o.s = nullptr;
+            p_o.shared = nullptr;
+            p_o.l = 0;
         }
     }
-    ~LuaString() {
-        if (s != nullptr) memfree(s);
+    GDRBLX_INLINE void release() {
+        if (s != nullptr && !is_inline())
+            shared->decref();
     }
-    LuaString& operator=(const LuaString& p_o) {
-        l = p_o.l;
-        s = (char*)memalloc((l+1)*sizeof(char));
-        if (p_o.s == nullptr) {
-            s[0] = 0;
+public:
+    char *s;
+    int l;
+
+    // Encodes straight into the string's own storage, no intermediate CharString.
+    LuaString(const ::godot::String& p_s) {
+        init(nullptr, internal::utf8_length(p_s));
+        internal::utf8_encode(p_s, s);
+    }
+    GDRBLX_INLINE LuaString() : shared(nullptr), s(nullptr), l(0) {}
+    GDRBLX_INLINE LuaString(std::nullptr_t) : shared(nullptr), s(nullptr), l(0) {}
+    // Uninitialized, writable string of p_len bytes.
+    GDRBLX_INLINE explicit LuaString(int p_len) {
+        init(nullptr, p_len);
+    }
+    GDRBLX_INLINE LuaString(const char* p_cs) {
+        init(p_cs, p_cs != nullptr ? strlen(p_cs) : 0);
+    }
+    GDRBLX_INLINE LuaString(const char* p_cs, size_t len) {
+        init(p_cs, len);
+    }
+    // Adopts a reference of the storage. Interned storage is always kept shared, so it compares by pointer.
+    GDRBLX_INLINE explicit LuaString(internal::LuaStringData *p_data) : s(p_data->data), l(p_data->len) {
+        if (l <= SSO_CAPACITY && !p_data->interned) {
+            memcpy(inline_buf, p_data->data, l + 1);
+            s = inline_buf;
+            cached_hash.store(p_data->hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            p_data->decref();
         } else {
-            memcpy(s,p_o.s,(l+1)*sizeof(char));
+            shared = p_data;
+            cached_hash.store(p_data->hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
         }
+    }
+    GDRBLX_INLINE LuaString(const LuaString& p_o) {
+        init_copy(p_o);
+    }
+    GDRBLX_INLINE LuaString(LuaString&& p_o) {
+        init_move(p_o);
+    }
+    GDRBLX_INLINE ~LuaString() {
+        release();
+    }
+    GDRBLX_INLINE LuaString& operator=(const LuaString& p_o) {
+        if (this == &p_o)
+            return *this;
+        release();
+        init_copy(p_o);
         return *this;
     }
+    GDRBLX_INLINE LuaString& operator=(LuaString&& p_o) {
+        if (this == &p_o)
+            return *this;
+        release();
+        init_move(p_o);
+        return *this;
+    }
+
+    // Returns a referenced LuaStringData with the contents, shared when the string is long.
+    GDRBLX_INLINE internal::LuaStringData* share() const {
+        if (s != nullptr && !is_inline()) {
+            shared->incref();
+            return shared;
+        }
+        internal::LuaStringData *d = internal::LuaStringData::create(s, l);
+        d->hash.store(cached_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return d;
+    }
+
+    GDRBLX_INLINE bool is_interned() const {
+        return s != nullptr && !is_inline() && shared->interned;
+    }
+    // Id of the LuaStringPool that interned the string, 0 if none did.
+    GDRBLX_INLINE uint32_t get_pool() const {
+        return is_interned() ? shared->pool : 0;
+    }
+
+    GDRBLX_INLINE uint32_t hash() const {
+        uint32_t h = cached_hash.load(std::memory_order_relaxed);
+        if (h != 0)
+            return h;
+        if (s != nullptr && !is_inline())
+            h = shared->hash.load(std::memory_order_relaxed);
+        if (h == 0) {
+            h = internal::lua_string_hash(s, l);
+            if (s != nullptr && !is_inline())
+                shared->hash.store(h, std::memory_order_relaxed);
+        }
+        cached_hash.store(h, std::memory_order_relaxed);
+        return h;
+    }
+
     operator const char* () const {
         return s;
     }
@@ -86,25 +269,29 @@ public:
         return s == nullptr;
     }
     bool operator==(const char* p_s) const {
+        if (s == nullptr || p_s == nullptr)
+            return s == p_s;
         return strcmp(p_s, this->s) == 0;
     }
     bool operator==(const LuaString& p_o) const {
-        return p_o.l==l and memcmp(p_o.s, s, l) == 0;
-    }
-    bool operator==(const LuaString&& p_o) const {
+        if (p_o.s == s)
+            return true;
+        if (is_interned() && p_o.is_interned() && shared->pool == p_o.shared->pool)
+            return false; // one block per contents within a pool.
+        const uint32_t h = cached_hash.load(std::memory_order_relaxed);
+        const uint32_t o = p_o.cached_hash.load(std::memory_order_relaxed);
+        if (h != 0 && o != 0 && h != o)
+            return false;
         return p_o.l==l and memcmp(p_o.s, s, l) == 0;
     }
     bool operator!=(std::nullptr_t) const {
         return s != nullptr;
     }
     bool operator!=(const char* p_s) const {
-        return strcmp(p_s, this->s) != 0;
+        return !(*this == p_s);
     }
     bool operator!=(const LuaString& p_o) const {
-        return p_o.l!=l or memcmp(p_o.s, s, l) != 0;
-    }
-    bool operator!=(const LuaString&& p_o) const {
-        return p_o.l!=l or memcmp(p_o.s, s, l) != 0;
+        return !(*this == p_o);
     }
 
     LuaString operator+(const LuaString& p_o) const {
@@ -118,10 +305,10 @@ public:
 class LuaStringHasher {
 public:
     GDRBLX_INLINE static uint32_t hash(const LuaString& p_s) {
-        return ::godot::hash_djb2_buffer((const uint8_t*)p_s.s,sizeof(char)*p_s.l);
+        return p_s.hash();
     }
 }; // class LuaStringHasher
 
 }; // namespace gdrblx
 
-#endif // STRING_HPP
\ No newline at end of file
+#endif // STRING_HPP
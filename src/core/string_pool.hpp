@@ -0,0 +1,110 @@
+#ifndef STRING_POOL_HPP
+#define STRING_POOL_HPP
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/local_vector.hpp>
+
+#include "macros.hpp"
+#include "string.hpp"
+
+namespace gdrblx {
+
+// Interning pool for identifiers: Instance names, attribute keys and the like. One per RobloxVM.
+// Interned strings share one LuaStringData with a precomputed hash, equal ones compare by pointer
+// and two interned by the same pool are unequal as soon as the pointers differ.
+class LuaStringPool final {
+    // Points into the interned data itself, or into the caller's buffer for lookups.
+    struct Key {
+        const char *s;
+        uint32_t len;
+        uint32_t hash;
+
+        GDRBLX_INLINE bool operator==(const Key& p_other) const {
+            return hash == p_other.hash && len == p_other.len && memcmp(s, p_other.s, len) == 0;
+        }
+    };
+    struct KeyHasher {
+        GDRBLX_INLINE static uint32_t hash(const Key& p_key) { return p_key.hash; }
+    };
+
+    struct Entry {
+        internal::LuaStringData *data = nullptr;
+        bool pinned = false; // never collected.
+    };
+
+    static inline std::atomic<uint32_t> next_id = 1;
+    const uint32_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+    ::godot::HashMap<Key, Entry, KeyHasher> strings;
+    mutable std::shared_mutex lock;
+
+    LuaString intern_string(const char *p_str, size_t p_len, uint32_t p_hash, bool p_pin) {
+        const Key key{ p_str, (uint32_t)p_len, p_hash };
+        if (!p_pin) {
+            std::shared_lock guard(lock);
+            auto it = strings.find(key);
+            if (it != strings.end()) {
+                it->value.data->incref();
+                return LuaString(it->value.data);
+            }
+        }
+        std::unique_lock guard(lock);
+        auto it = strings.find(key);
+        if (it == strings.end()) {
+            internal::LuaStringData *data = internal::LuaStringData::create(p_str, p_len);
+            data->interned = true;
+            data->pool = id;
+            data->hash.store(p_hash, std::memory_order_relaxed);
+            it = strings.insert(Key{ data->data, (uint32_t)p_len, p_hash }, Entry{ data });
+        }
+        it->value.pinned = it->value.pinned || p_pin;
+        it->value.data->incref();
+        return LuaString(it->value.data);
+    }
+public:
+    LuaStringPool() {}
+    LuaStringPool(const LuaStringPool&) = delete;
+    ~LuaStringPool() {
+        for (auto& kv : strings)
+            kv.value.data->decref();
+    }
+
+    GDRBLX_INLINE uint32_t get_id() const { return id; }
+
+    GDRBLX_INLINE LuaString intern_string(const char *p_str, size_t p_len) {
+        return intern_string(p_str, p_len, internal::lua_string_hash(p_str, p_len), false);
+    }
+    GDRBLX_INLINE LuaString intern_string(const LuaString& p_str) {
+        if (p_str.get_pool() == id || p_str.s == nullptr)
+            return p_str;
+        return intern_string(p_str.s, p_str.l, p_str.hash(), false);
+    }
+    // Kept for the lifetime of the pool, for names registered by the engine (classes, methods).
+    GDRBLX_INLINE LuaString pin_string(const LuaString& p_str) {
+        if (p_str.s == nullptr)
+            return p_str;
+        return intern_string(p_str.s, p_str.l, p_str.hash(), true);
+    }
+
+    // Releases interned strings nothing but the pool references anymore.
+    void collect() {
+        std::unique_lock guard(lock);
+        ::godot::LocalVector<Key> unused;
+        for (auto& kv : strings) {
+            if (!kv.value.pinned && kv.value.data->ref_count.get() == 1)
+                unused.push_back(kv.key);
+        }
+        for (const Key& key : unused) {
+            internal::LuaStringData *data = strings[key].data;
+            strings.erase(key); // the key points into the data.
+            data->decref();
+        }
+    }
+}; // class LuaStringPool
+
+} // namespace gdrblx
+
+#endif // STRING_POOL_HPP
@@ -1,15 +1,21 @@
 #ifndef TABLE_HPP
 #define TABLE_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <utility>
-#include <shared_mutex>
+#include <mutex>
 
 #include <lua.h>
 #include <godot_cpp/core/error_macros.hpp>
 #include <godot_cpp/templates/hash_map.hpp>
 #include <godot_cpp/templates/vector.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_float32_array.hpp>
 
 #include "macros.hpp"
+#include "epoch.hpp"
 #include "object.hpp"
 
 namespace gdrblx {
@@ -40,22 +46,264 @@ public:
 } // namespace internal
 
 class LuaTable {
-    HashMap<LuaObject, LuaObject, LuaObjectHasher> map;
+    // Integer keys 1..n live in the array part, key n+1 is never in the hash part.
+    // Removing a key leaves a nil hole instead of moving the tail out, the last slot is never nil
+    // so n is always a border. holes counts the nil slots.
+    LocalVec<LuaObject> array;
+    uint32_t holes = 0;
+    uint32_t array_first = 0; // slots before it are all holes.
+    uint32_t array_high = 0; // largest size the array part was trimmed from, next() still knows keys up to it.
+    // The hash part keeps its entries in insertion order, so an iteration cursor is just a slot.
+    // Removed entries keep their slot with a nil value, next() still finds them, until
+    // the dead ones make up half of the nodes and a later insertion compacts them away.
+    // Only insertions compact, so removals alone can leave any number of dead nodes behind.
+    // first_live skips the leading ones, popping entries with next(t) stays linear.
+    struct Node {
+        LuaObject key;
+        LuaObject value;
+    };
+    LocalVec<Node> nodes;
+    HashMap<LuaObject, uint32_t, LuaObjectHasher> index;
+    uint32_t dead = 0;
+    uint32_t first_live = 0; // nodes before it are all dead.
     internal::LuaTableProperty property;
     bool frozen = false;
+    // Frozen for good with immutable contents only, set by LuaObject::seal.
+    // Sealed tables are shared between states instead of copied.
+    mutable std::atomic<bool> sealed = false;
 
     friend class LuaIpairsIterator;
+    friend class LuaObject;
+    friend class SharedTable;
+
+    static constexpr size_t HASH_CURSOR = size_t(1) << 62; // cursors below are array positions, 1 based.
+
+    // 0 based array slot for integral keys, -1 for anything else.
+    GDRBLX_INLINE static int64_t array_index(const LuaObject& p_key) {
+        if (p_key.type == LuaObject::INTEGER)
+            return (int64_t)p_key.integer - 1;
+        if (p_key.type == LuaObject::NUMBER && p_key.number >= 1 && p_key.number <= (lua_Number)UINT32_MAX) {
+            const int64_t i = (int64_t)p_key.number;
+            if ((lua_Number)i == p_key.number)
+                return i - 1;
+        }
+        return -1;
+    }
+    GDRBLX_INLINE int64_t find_node(const LuaObject& p_key) const {
+        if (nodes.is_empty())
+            return -1;
+        const auto it = index.find(p_key);
+        return it != index.end() ? (int64_t)it->value : -1;
+    }
+    GDRBLX_INLINE const LuaObject* find_slot(const LuaObject& p_key) const {
+        const int64_t i = array_index(p_key);
+        if (i >= 0 && i < (int64_t)array.size())
+            return array[i].type != LuaObject::NIL ? &array[i] : nullptr;
+        const int64_t n = find_node(p_key);
+        if (n < 0 || nodes[n].value.type == LuaObject::NIL)
+            return nullptr;
+        return &nodes[n].value;
+    }
+    void compact() {
+        LocalVec<Node> live;
+        live.reserve(nodes.size() - dead);
+        index.clear();
+        for (Node& n : nodes) {
+            if (n.value.type == LuaObject::NIL)
+                continue;
+            index.insert(n.key, live.size());
+            live.push_back(std::move(n));
+        }
+        nodes = std::move(live);
+        dead = 0;
+        first_live = 0;
+    }
+    // Moved forward when the entry they point at is removed, back when one before them is set.
+    GDRBLX_INLINE void skip_array_holes() {
+        while (array_first < array.size() && array[array_first].type == LuaObject::NIL)
+            array_first++;
+    }
+    GDRBLX_INLINE void skip_dead_nodes() {
+        while (first_live < nodes.size() && nodes[first_live].value.type == LuaObject::NIL)
+            first_live++;
+    }
+    GDRBLX_INLINE void lower_array_first(uint32_t p_idx) {
+        array_first = std::min(array_first, p_idx);
+    }
+    // p_compact is false while moving entries out of the array part, cursors into the hash part stay valid.
+    void set_node(const LuaObject& p_key, const LuaObject& p_value, bool p_compact = true) {
+        const int64_t n = find_node(p_key);
+        const bool remove = p_value.is_null();
+        if (n >= 0) {
+            Node& node = nodes[n];
+            const bool was_dead = node.value.type == LuaObject::NIL;
+            if (remove && !was_dead)
+                dead++;
+            else if (!remove && was_dead)
+                dead--;
+            node.value = remove ? NIL_OBJECT_REF : p_value;
+            if (!remove)
+                first_live = std::min(first_live, (uint32_t)n);
+            else if ((uint32_t)n == first_live)
+                skip_dead_nodes();
+            return;
+        }
+        if (remove)
+            return;
+        if (p_compact && dead > 0 && dead * 2 >= nodes.size())
+            compact();
+        index.insert(p_key, nodes.size());
+        nodes.push_back(Node{ p_key, p_value });
+    }
+    // Pulls n+1, n+2... over from the hash part after the array grew.
+    void migrate_from_hash() {
+        while (nodes.size() > dead) {
+            const int64_t n = find_node(LuaObject((lua_Integer)(array.size() + 1)));
+            if (n < 0 || nodes[n].value.type == LuaObject::NIL)
+                return;
+            array.push_back(std::move(nodes[n].value));
+            nodes[n].value = NIL_OBJECT_REF;
+            dead++;
+            if ((uint32_t)n == first_live)
+                skip_dead_nodes();
+        }
+    }
+    // Drops the nil slots at the end, so the last one holds a value again.
+    GDRBLX_INLINE void trim_array() {
+        uint32_t n = array.size();
+        array_high = std::max(array_high, n);
+        while (n > 0 && array[n - 1].type == LuaObject::NIL) {
+            n--;
+            holes--;
+        }
+        array.resize(n);
+    }
+    GDRBLX_INLINE uint32_t count_holes(uint32_t p_from, uint32_t p_to) const {
+        uint32_t count = 0;
+        for (uint32_t i = p_from; i < p_to; i++)
+            count += array[i].type == LuaObject::NIL;
+        return count;
+    }
+    void set_array(int64_t p_idx, const LuaObject& p_value) {
+        if (p_idx == (int64_t)array.size()) {
+            if (p_value.is_null())
+                return;
+            lower_array_first(p_idx);
+            const LuaObject value = p_value; // may point into array, which push_back can reallocate.
+            array.push_back(value);
+            migrate_from_hash();
+            return;
+        }
+        LuaObject& slot = array[p_idx];
+        const bool was_hole = slot.type == LuaObject::NIL;
+        if (!p_value.is_null()) {
+            holes -= was_hole;
+            slot = p_value;
+            lower_array_first(p_idx);
+            return;
+        }
+        if (was_hole)
+            return;
+        slot = NIL_OBJECT_REF; // a hole, the rest stays where it is.
+        holes++;
+        if (p_idx == (int64_t)array.size() - 1)
+            trim_array();
+        if (p_idx == (int64_t)array_first)
+            skip_array_holes();
+    }
+    struct Sort; // table_sort.cpp
+    // Frozen while a comparison may run script code, so it can not move the array from under the sort.
+    // Nil holes are sorted like any other value and may end up anywhere, also when a comparison
+    // failed halfway, so end_sort fixes up the first slot and the trailing ones.
+    // Called explicitly, a Luau error longjmps past destructors.
+    GDRBLX_INLINE void begin_sort() {
+        frozen = true;
+    }
+    GDRBLX_INLINE void end_sort() {
+        frozen = false;
+        if (holes > 0) {
+            trim_array();
+            array_first = 0;
+            skip_array_holes();
+        }
+    }
+    typedef bool (*SortLess)(void *p_comparator, const LuaObject& a, const LuaObject& b);
+    template <typename Comparator>
+    GDRBLX_INLINE static bool sort_less(void *p_comparator, const LuaObject& a, const LuaObject& b) {
+        return (bool)(*(Comparator*)p_comparator)(a, b);
+    }
+    // For comparisons that may run script code, defined in table_sort.cpp. An inconsistent order
+    // fails with an error instead of reading past the array. The sort stops early once *p_failed
+    // is set, with every value still in the array.
+    void sort_checked(SortLess p_less, void *p_comparator, bool p_stable, const bool *p_failed = nullptr);
+    // LuaObject holds no pointers into itself, so shifting array slots as plain bytes relocates
+    // them without touching any refcount. The slots left behind must be rewritten as raw bytes too.
+    GDRBLX_INLINE void relocate_array(uint32_t p_from, uint32_t p_to, uint32_t p_count) {
+        memmove((void*)(array.ptr() + p_to), (const void*)(array.ptr() + p_from), p_count * sizeof(LuaObject));
+    }
+    // table.move between array parts, false if either range leaves them.
+    bool move_array(const LuaTable& p_src, int64_t p_from, int64_t p_to, int64_t p_count) {
+        if (p_from < 0 || p_from + p_count > (int64_t)p_src.array.size() || p_to < 0 || p_to > (int64_t)array.size())
+            return false;
+        const int64_t end = p_to + p_count;
+        for (int64_t i = array.size(); i < end; i++) // about to be covered by the array part.
+            set_node(LuaObject((lua_Integer)(i + 1)), NIL_OBJECT_REF);
+        if (end > (int64_t)array.size()) {
+            holes += end - array.size();
+            array.resize(end); // nil only until the copy below fills it.
+        }
+        holes -= count_holes(p_to, end);
+        if (&p_src == this && p_to > p_from) {
+            for (int64_t i = p_count - 1; i >= 0; i--)
+                array[p_to + i] = array[p_from + i];
+        } else {
+            for (int64_t i = 0; i < p_count; i++)
+                array[p_to + i] = p_src.array[p_from + i];
+        }
+        holes += count_holes(p_to, end); // the source may have had holes.
+        lower_array_first(p_to);
+        trim_array();
+        migrate_from_hash();
+        return true;
+    }
 
 public:
     LuaTable() : property(this) {}
-    LuaTable(const LuaTable& p_other) : property(this), map(p_other.map), frozen(p_other.frozen) {}
-    LuaTable(const LuaTable&& p_other) : property(this), map(p_other.map), frozen(p_other.frozen) {}
+    LuaTable(const LuaTable& p_other) : property(this), array(p_other.array), holes(p_other.holes), array_first(p_other.array_first), array_high(p_other.array_high), nodes(p_other.nodes), index(p_other.index), dead(p_other.dead), first_live(p_other.first_live), frozen(p_other.frozen) {}
+    LuaTable(LuaTable&& p_other) : property(this), array(std::move(p_other.array)), holes(p_other.holes), array_first(p_other.array_first), array_high(p_other.array_high), nodes(std::move(p_other.nodes)), index(std::move(p_other.index)), dead(p_other.dead), first_live(p_other.first_live), frozen(p_other.frozen) {}
+
+    LuaTable& operator=(const LuaTable& p_other) {
+        DEV_ASSERT(!is_sealed());
+        array = p_other.array;
+        holes = p_other.holes;
+        array_first = p_other.array_first;
+        array_high = p_other.array_high;
+        nodes = p_other.nodes;
+        index = p_other.index;
+        dead = p_other.dead;
+        first_live = p_other.first_live;
+        frozen = p_other.frozen;
+        return *this;
+    }
+    LuaTable& operator=(LuaTable&& p_other) {
+        DEV_ASSERT(!is_sealed());
+        array = std::move(p_other.array);
+        holes = p_other.holes;
+        array_first = p_other.array_first;
+        array_high = p_other.array_high;
+        nodes = std::move(p_other.nodes);
+        index = std::move(p_other.index);
+        dead = p_other.dead;
+        first_live = p_other.first_live;
+        frozen = p_other.frozen;
+        return *this;
+    }
 
     struct LuaTableIteration {
         friend class LuaTable;
         friend class LuaIpairsIterator;
 
-        const LuaObject& key;
+        const LuaObject key; // array part keys are not stored anywhere.
         const LuaObject& value;
 
         GDRBLX_INLINE bool valid() const { return idx != 0; }
@@ -95,15 +343,18 @@ public:
         friend class LuaTable;
         const LuaTable* t;
         LuaTableIteration it;
+        GDRBLX_INLINE void seek(lua_Integer p_idx) {
+            const LuaObject *v = t->find_slot(p_idx);
+            if (v == nullptr)
+                it = LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0);
+            else
+                it = LuaTableIteration(p_idx, *v, p_idx);
+        }
         LuaIpairsIterator(const LuaTable* p_t) : t(p_t), it(LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0)) {
-            auto kv = t->map.find(1);
-            if (kv != t->map.end())
-                it = LuaTableIteration(kv->key, kv->value, 1);
+            seek(1);
         }
         LuaIpairsIterator(const LuaTable* p_t, lua_Integer p_start) : t(p_t), it(LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0)) {
-            auto kv = t->map.find(p_start);
-            if (kv != t->map.end())
-                it = LuaTableIteration(kv->key, kv->value, p_start);
+            seek(p_start);
         }
     public:
         GDRBLX_INLINE bool valid() const { return it.valid(); }
@@ -115,20 +366,16 @@ public:
             return &it;
         }
         GDRBLX_INLINE virtual LuaIpairsIterator& operator++() {
-            lua_Integer new_idx = (it.idx != 0) ? it.idx+1 : 0;
-            if (new_idx == 0)
-                it = LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0);
-            else {
-                auto kv = t->map.find(new_idx);
-                if (kv == t->map.end())
-                    it = LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0);
-                else
-                    it = LuaTableIteration(kv->key, kv->value, new_idx);
-            }
+            if (it.idx != 0)
+                seek((lua_Integer)it.idx + 1);
             return *this;
         }
     };
 
+private:
+    // First entry at or after p_cursor.
+    LuaTableIteration iteration_at(size_t p_cursor) const;
+public:
     GDRBLX_INLINE const LuaObject& operator[](const LuaObject& p_key) const {
         return get(p_key);
     }
@@ -137,55 +384,54 @@ public:
         return property;
     }
     GDRBLX_INLINE virtual bool has(const LuaObject& p_key) const {
-        return map.has(p_key);
+        return find_slot(p_key) != nullptr;
     }
     GDRBLX_INLINE virtual const LuaObject& get(const LuaObject& p_key) const {
-        const auto iterator = map.find(p_key);
-
-        if (iterator != map.end())
-            return iterator->value;
-
-        return NIL_OBJECT_REF;
+        const LuaObject *v = find_slot(p_key);
+        return v != nullptr ? *v : NIL_OBJECT_REF;
     }
+    // Assigning nil removes the key.
     GDRBLX_INLINE virtual void set(const LuaObject& p_key, const LuaObject& p_value) {
         DEV_ASSERT(!frozen);
-        ERR_FAIL_COND(!frozen);
-        map.insert(p_key,p_value);    
+        ERR_FAIL_COND(frozen);
+        const int64_t i = array_index(p_key);
+        if (i >= 0 && i <= (int64_t)array.size()) {
+            set_array(i, p_value);
+            return;
+        }
+        set_node(p_key, p_value);
     }
     GDRBLX_INLINE virtual size_t size() const {
-        return map.size();
+        return array.size() - holes + nodes.size() - dead;
     }
+    // A border like the length operator's, keys up to it may still be missing.
     GDRBLX_INLINE virtual size_t arr_len() const {
-        size_t i;
-        for (i=1; has(i); i++) {}
-        return i-1;
+        return array.size();
     }
 
+    // Array part first, then the hash part in insertion order, holes and dead nodes skipped.
+    // Assigning to existing keys, nil included, is fine while iterating.
     GDRBLX_INLINE virtual LuaTableIteration next() const {
-        const auto kv = map.begin();
-        if (kv != map.end()) {
-            return LuaTableIteration(kv->key, kv->value, 1);
-        }
-        return LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0);
+        return iteration_at(1);
     }
+    // The entry after p_key, like lua_next.
     GDRBLX_INLINE virtual LuaTableIteration next(const LuaObject& p_key) const {
-        const auto kv = map.begin();
-        size_t idx = 1;
-        while (kv != map.end()) {
-            if (kv->key == p_key)
-                return LuaTableIteration(kv->key, kv->value, idx);
-            idx++;
-        }
-        return LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0);
+        if (p_key.is_null())
+            return iteration_at(1);
+        const int64_t i = array_index(p_key);
+        if (i >= 0 && i < (int64_t)array.size())
+            return iteration_at(i + 2);
+        const int64_t n = find_node(p_key);
+        if (n < 0 && i >= 0 && i < (int64_t)array_high) // removed from the end of the array part, which shrank since.
+            return iteration_at(HASH_CURSOR);
+        if (n < 0)
+            return LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0);
+        return iteration_at(HASH_CURSOR | (n + 1));
     }
     GDRBLX_INLINE virtual LuaTableIteration next(const LuaTableIteration& p_last) const {
-        auto kv = map.begin();
-        size_t idx;
-        for (idx = 1; idx <= p_last.idx; idx++)
-            ++kv;
-        if ((bool)kv) 
-            return LuaTableIteration(kv->key, kv->value, idx);
-        return LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0);
+        if (!p_last.valid())
+            return p_last;
+        return iteration_at(p_last.idx + 1);
     }
     GDRBLX_INLINE virtual LuaPairsIterator pairs() const {
         return LuaPairsIterator(this);
@@ -200,14 +446,26 @@ public:
 
     GDRBLX_INLINE virtual void clear() {
         DEV_ASSERT(!frozen);
-        ERR_FAIL_COND(!frozen);
-        map.clear();
+        ERR_FAIL_COND(frozen);
+        array.clear();
+        holes = 0;
+        array_first = 0;
+        array_high = 0;
+        nodes.clear();
+        index.clear();
+        dead = 0;
+        first_live = 0;
     }
     GDRBLX_INLINE LuaTable clone() const {
         LuaTable t;
-        for (const auto& kv : this->map) {
-            t[kv.key] = kv.value;
-        }
+        t.array = array;
+        t.holes = holes;
+        t.array_first = array_first;
+        t.array_high = array_high;
+        t.nodes = nodes;
+        t.index = index;
+        t.dead = dead;
+        t.first_live = first_live;
         return std::move(t);
     }
     GDRBLX_INLINE LuaString concat(LuaString p_sep, lua_Integer p_i = 1) const {
@@ -269,15 +527,22 @@ public:
         }
         return final_result;
     }
+    // Godot interop, defined in variant.cpp.
+    static LuaTable from_packed_float32_array(const ::godot::PackedFloat32Array& p_array);
+    ::godot::PackedFloat32Array to_packed_float32_array() const;
+    static LuaTable from_dictionary(const ::godot::Dictionary& p_dict);
+    ::godot::Dictionary to_dictionary() const;
+
     GDRBLX_INLINE static LuaTable create(lua_Integer p_count, const LuaObject& p_value) {
         LuaTable t;
-        t.map.reserve(p_count);
-        for (int i = 1; i <= p_count; i++) {
-            t[i] = p_value;
-        }
+        if (p_count <= 0 || p_value.is_null())
+            return t;
+        t.array.resize(p_count);
+        for (LuaObject& v : t.array)
+            v = p_value;
         return t;
     }
-    GDRBLX_INLINE const LuaObject& find(const LuaObject& p_needle, lua_Integer p_init = 1) const {
+    GDRBLX_INLINE LuaObject find(const LuaObject& p_needle, lua_Integer p_init = 1) const {
         auto it = ipairs(p_init);
         while (it.valid()) {
             if (it->value == p_needle)
@@ -306,12 +571,29 @@ public:
         frozen = true;
     }
     GDRBLX_INLINE virtual void unfreeze() {
+        ERR_FAIL_COND_MSG(is_sealed(), "Cannot unfreeze a table shared between states.");
         frozen = false;
     }
+    GDRBLX_INLINE bool is_sealed() const {
+        return sealed.load(std::memory_order_acquire);
+    }
     GDRBLX_INLINE lua_Integer getn() const {
         return size();
     }
     GDRBLX_INLINE void insert(lua_Integer p_pos, const LuaObject& p_value) {
+        const int64_t i = p_pos - 1;
+        if (i >= 0 && i <= (int64_t)array.size() && !p_value.is_null()) {
+            DEV_ASSERT(!frozen);
+            ERR_FAIL_COND(frozen);
+            const LuaObject value = p_value; // may point into array, which is about to move.
+            const uint32_t n = array.size();
+            array.push_back(LuaObject());
+            relocate_array(i, i + 1, n - i);
+            new (&array[i]) LuaObject(value);
+            lower_array_first(i);
+            migrate_from_hash();
+            return;
+        }
         lua_Integer idx = p_pos;
         LuaObject to_move = p_value;
         bool moved = false;
@@ -338,12 +620,37 @@ public:
         return n;
     }
     GDRBLX_INLINE LuaTable& move(const LuaTable& p_src, lua_Integer p_a, lua_Integer p_b, lua_Integer p_t) {
-        for (size_t src_idx = p_a; src_idx <= p_b; src_idx++) {
+        DEV_ASSERT(!frozen);
+        ERR_FAIL_COND_V(frozen, *this);
+        if (p_b < p_a || move_array(p_src, (int64_t)p_a - 1, (int64_t)p_t - 1, (int64_t)p_b - p_a + 1))
+            return *this;
+        if (&p_src == this && p_t > p_a && p_t <= p_b) { // overlapping, copy from the back.
+            for (lua_Integer src_idx = p_b; src_idx >= p_a; src_idx--)
+                set(src_idx-p_a+p_t, p_src.get(src_idx));
+            return *this;
+        }
+        for (lua_Integer src_idx = p_a; src_idx <= p_b; src_idx++) {
             set(src_idx-p_a+p_t, p_src.get(src_idx));
         }
         return *this;
     }
     GDRBLX_INLINE LuaObject remove(lua_Integer p_pos) {
+        const int64_t i = p_pos - 1;
+        if (i >= 0 && i < (int64_t)array.size()) {
+            DEV_ASSERT(!frozen);
+            ERR_FAIL_COND_V(frozen, LuaObject());
+            const uint32_t n = array.size();
+            LuaObject obj = std::move(array[i]);
+            holes -= obj.type == LuaObject::NIL;
+            relocate_array(i + 1, i, n - i - 1);
+            new (&array[n - 1]) LuaObject(); // its bytes moved down, forget them.
+            array_high = std::max(array_high, n);
+            array.resize(n - 1);
+            trim_array(); // a hole may have become the last slot.
+            lower_array_first(i);
+            skip_array_holes();
+            return obj;
+        }
         LuaObject obj;
         lua_Integer idx = p_pos;
 
@@ -356,168 +663,724 @@ public:
         }
         return obj;
     }
-    GDRBLX_INLINE void sort() {
-        Vec<LuaObject> vec;
-        foreachi([&vec](const LuaObject& k, const LuaObject& v) {
-            vec.push_back(v);
-        });
-        vec.sort();
-        for (lua_Integer i = 0; i < vec.size(); i++)
-            set(i+1, vec[i]);
-    }
+    // In place on the array part, defined in table_sort.cpp. All-number and all-string arrays
+    // compare without dispatching through LuaObject, large ones are merge sorted on the WorkerThreadPool.
+    void sort();
+    // Like sort, equal elements keep their order.
+    void stable_sort();
+    // The comparator must not raise, script comparisons go through the lua_State overload.
     template <typename Comparator>
     GDRBLX_INLINE void sort(Comparator comparator) {
-        Vec<LuaObject> vec;
-        foreachi([&vec](const LuaObject& k, const LuaObject& v) {
-            vec.push_back(v);
-        });
-        vec.sort(comparator);
-        for (lua_Integer i = 0; i < vec.size(); i++)
-            set(i+1, vec[i]);
+        DEV_ASSERT(!frozen);
+        ERR_FAIL_COND(frozen);
+        begin_sort();
+        sort_checked(&sort_less<Comparator>, &comparator, false);
+        end_sort();
     }
+    template <typename Comparator>
+    GDRBLX_INLINE void stable_sort(Comparator comparator) {
+        DEV_ASSERT(!frozen);
+        ERR_FAIL_COND(frozen);
+        begin_sort();
+        sort_checked(&sort_less<Comparator>, &comparator, true);
+        end_sort();
+    }
+    // Like table.sort, p_comparator is a Luau function or nil for the < operator and its
+    // metamethods, every comparison runs under lua_pcall on p_L. An error stops the sort, the table
+    // is restored and false returned with the error in r_error, for the caller to raise.
+    bool sort(lua_State *p_L, const LuaObject& p_comparator, LuaObject& r_error, bool p_stable = false);
 }; // class LuaTable
 
-class SharedTable : protected LuaTable {
-    friend class LuaIpairsIteratorThreaded;
-    mutable std::shared_mutex lock;
+inline LuaTable::LuaTableIteration LuaTable::iteration_at(size_t p_cursor) const {
+    if (!(p_cursor & HASH_CURSOR)) {
+        for (size_t i = std::max(p_cursor, (size_t)array_first + 1); i <= array.size(); i++) {
+            if (array[i - 1].type != LuaObject::NIL)
+                return LuaTableIteration((lua_Integer)i, array[i - 1], i);
+        }
+        p_cursor = HASH_CURSOR; // past the array part, it may have shrunk since.
+    }
+    for (size_t i = std::max(p_cursor & ~HASH_CURSOR, (size_t)first_live); i < nodes.size(); i++) {
+        const Node& n = nodes[i];
+        if (n.value.type != LuaObject::NIL)
+            return LuaTableIteration(n.key, n.value, HASH_CURSOR | i);
+    }
+    return LuaTableIteration(NIL_OBJECT_REF, NIL_OBJECT_REF, 0);
+}
+
+// Table shared between Actors, read-copy-update so that readers never lock.
+// Every key owns a cell holding its value in one word. Assigning to an existing key swaps
+// the word, adding or removing keys publishes a new version of the key layout.
+// Readers pin what they load with an EpochGuard, replaced versions, cells and boxes are
+// freed through the EpochDomain once no reader can see them. Structural writers serialize
+// on write_lock, increment and update only compare-exchange the word of an existing cell.
+class SharedTable {
+    struct Box {
+        const LuaObject value;
+        GDRBLX_INLINE Box(const LuaObject& p_value) : value(p_value) {}
+    };
+    // Numbers whose lowest mantissa bit is clear, integral ones up to 2^52 included, are stored
+    // in place with that bit set, so increment rarely allocates. Anything else is a pointer to a
+    // Box kept at full width, tagged pointers and wide address spaces included. Boxes are aligned
+    // so the pointer's low bits are free, the second one marks a box moved. A writer that drops or
+    // rebuilds a cell marks its box moved first, which fails every compare-exchange still aimed
+    // at it so lock-free writers retry on the next version.
+    static constexpr uint64_t NUMBER_TAG = 1;
+    static constexpr uint64_t BOX_TAG = 0;
+    static constexpr uint64_t MOVED_TAG = 2;
+    static constexpr uint64_t CANONICAL_NAN = 0x7FF8ull << 48;
+    static constexpr lua_Integer EXACT_INTEGER = lua_Integer(1) << 53; // larger ones may not survive a double.
+
+    GDRBLX_INLINE static bool is_number(uint64_t p_word) { return (p_word & NUMBER_TAG) != 0; }
+    GDRBLX_INLINE static bool is_moved(uint64_t p_word) { return (p_word & (NUMBER_TAG | MOVED_TAG)) == MOVED_TAG; }
+    GDRBLX_INLINE static Box* box_of(uint64_t p_word) { return (Box*)(uintptr_t)(p_word & ~MOVED_TAG); }
+    GDRBLX_INLINE static lua_Number to_number(uint64_t p_word) {
+        p_word &= ~NUMBER_TAG;
+        lua_Number n;
+        memcpy(&n, &p_word, sizeof(n));
+        return n;
+    }
+    GDRBLX_INLINE static uint64_t from_number(lua_Number p_number) {
+        if (p_number != p_number)
+            return CANONICAL_NAN;
+        uint64_t word;
+        memcpy(&word, &p_number, sizeof(word));
+        return word;
+    }
+    GDRBLX_INLINE static uint64_t box_word(Box *p_box, uint64_t p_tag) {
+        DEV_ASSERT(((uintptr_t)p_box & (NUMBER_TAG | MOVED_TAG)) == 0);
+        return p_tag | (uint64_t)(uintptr_t)p_box;
+    }
+    static uint64_t encode_number(lua_Number p_number) {
+        const uint64_t word = from_number(p_number);
+        if ((word & NUMBER_TAG) == 0)
+            return word | NUMBER_TAG;
+        return box_word(memnew(Box(LuaObject(p_number))), BOX_TAG);
+    }
+    // Allocates a box for anything but most numbers, free_word releases it if it was never published.
+    // Luau only has doubles, integers exact in one come back as numbers, larger ones stay integers.
+    static uint64_t encode(const LuaObject& p_value) {
+        if (p_value.type == LuaObject::NUMBER)
+            return encode_number(p_value.number);
+        if (p_value.type == LuaObject::INTEGER && p_value.integer >= -EXACT_INTEGER && p_value.integer <= EXACT_INTEGER)
+            return encode_number((lua_Number)p_value.integer);
+        return box_word(memnew(Box(p_value)), BOX_TAG);
+    }
+    GDRBLX_INLINE static LuaObject decode(uint64_t p_word) {
+        return is_number(p_word) ? LuaObject(to_number(p_word)) : box_of(p_word)->value;
+    }
+    GDRBLX_INLINE static void free_word(uint64_t p_word) {
+        if (!is_number(p_word))
+            ::godot::memdelete(box_of(p_word));
+    }
+    GDRBLX_INLINE static void retire_word(uint64_t p_word) {
+        if (!is_number(p_word))
+            internal::EpochDomain::retire(box_of(p_word));
+    }
+    // Whether p_word, loaded in the current EpochGuard, still holds p_value decoded from the cell
+    // in an earlier one. Compares values, the box it came from may have been freed and reused.
+    GDRBLX_INLINE static bool holds(uint64_t p_word, const LuaObject& p_value) {
+        if (is_moved(p_word))
+            return false;
+        if (is_number(p_word))
+            return p_value.type == LuaObject::NUMBER && from_number(p_value.number) == (p_word & ~NUMBER_TAG);
+        const LuaObject& value = box_of(p_word)->value;
+        if (value.type == LuaObject::NUMBER) // NaN never equals itself.
+            return p_value.type == LuaObject::NUMBER && from_number(value.number) == from_number(p_value.number);
+        return ::godot::HashMapComparatorDefault<LuaObject>::compare(value, p_value);
+    }
 
-    class LuaIpairsIteratorThreaded : public LuaIpairsIterator {
+    struct Cell {
+        std::atomic<uint64_t> word;
+        GDRBLX_INLINE Cell(const LuaObject& p_value) : word(encode(p_value)) {}
+        GDRBLX_INLINE ~Cell() {
+            free_word(word.load(std::memory_order_relaxed));
+        }
+    };
+    // Cells dropped by one write, retired together.
+    struct CellBatch {
+        LocalVec<Cell*> cells;
+        ~CellBatch() {
+            for (Cell *cell : cells)
+                ::godot::memdelete(cell);
+        }
+    };
+    // Keys in insertion order with an open addressing index over them, shared by every version
+    // that only appended to it. Writers append past the last published count under write_lock and
+    // an entry is complete before its index slot is published, readers ignore entries at or above
+    // the count of their version. Removing a key clears its cell in place, the entry stays so
+    // cursors remain valid and the key can come back without touching the index.
+    struct Layout {
+        struct Entry {
+            const LuaObject key;
+            std::atomic<Cell*> cell; // null once removed.
+            GDRBLX_INLINE Entry(const LuaObject& p_key, Cell *p_cell) : key(p_key), cell(p_cell) {}
+        };
+        static constexpr uint32_t MIN_CAPACITY = 8;
+        static inline std::atomic<uint64_t> next_id = 1;
+
+        Entry *entries;
+        std::atomic<uint32_t> *slots; // entry + 1, 0 while free. Twice the capacity, a power of two.
+        const uint32_t capacity;
+        uint32_t used = 0;
+        const uint64_t id = next_id.fetch_add(1, std::memory_order_relaxed); // unlike the address, never reused.
+
+        Layout(uint32_t p_capacity) : capacity(p_capacity) {
+            entries = (Entry*)memalloc(sizeof(Entry) * capacity);
+            slots = (std::atomic<uint32_t>*)memalloc(sizeof(std::atomic<uint32_t>) * capacity * 2);
+            for (uint32_t i = 0; i < capacity * 2; i++)
+                new (&slots[i]) std::atomic<uint32_t>(0);
+        }
+        ~Layout() {
+            for (uint32_t i = 0; i < used; i++)
+                entries[i].~Entry(); // the cells belong to the table.
+            memfree(entries);
+            memfree(slots);
+        }
+        // Room for p_count entries without growing, at most half of the slots in use.
+        static uint32_t capacity_for(uint32_t p_count) {
+            uint32_t c = MIN_CAPACITY;
+            while (c < p_count)
+                c <<= 1;
+            return c;
+        }
+        int64_t find(const LuaObject& p_key, uint32_t p_count) const {
+            const uint32_t mask = capacity * 2 - 1;
+            for (uint32_t i = LuaObjectHasher::hash(p_key) & mask;; i = (i + 1) & mask) {
+                const uint32_t slot = slots[i].load(std::memory_order_acquire);
+                if (slot == 0)
+                    return -1;
+                if (::godot::HashMapComparatorDefault<LuaObject>::compare(entries[slot - 1].key, p_key))
+                    return slot - 1 < p_count ? (int64_t)(slot - 1) : -1; // appended after p_count.
+            }
+        }
+        // Under write_lock, p_key must not be present and used below capacity.
+        void append(const LuaObject& p_key, Cell *p_cell) {
+            new (&entries[used]) Entry(p_key, p_cell);
+            const uint32_t mask = capacity * 2 - 1;
+            uint32_t i = LuaObjectHasher::hash(p_key) & mask;
+            while (slots[i].load(std::memory_order_relaxed) != 0)
+                i = (i + 1) & mask;
+            slots[i].store(++used, std::memory_order_release);
+        }
+    };
+    // Never modified once published, writers change a copy. Copies share the layout,
+    // so adding or removing a key costs O(1) instead of copying the whole key set.
+    struct Version {
+        Layout *layout;
+        uint32_t count = 0; // entries of the layout this version sees.
+        uint32_t dead = 0;
+        uint32_t border = 0; // keys 1..border are all present.
+        bool frozen = false;
+
+        explicit Version(uint32_t p_capacity = Layout::MIN_CAPACITY) : layout(memnew(Layout(p_capacity))) {}
+        Version(const Version& p_other) = default;
+
+        GDRBLX_INLINE int64_t find_entry(const LuaObject& p_key) const {
+            if (count == 0)
+                return -1;
+            return layout->find(p_key, count);
+        }
+        GDRBLX_INLINE Cell* cell_at(uint32_t p_entry) const {
+            return layout->entries[p_entry].cell.load(std::memory_order_acquire);
+        }
+        GDRBLX_INLINE Cell* find(const LuaObject& p_key) const {
+            const int64_t i = find_entry(p_key);
+            return i >= 0 ? cell_at(i) : nullptr;
+        }
+        GDRBLX_INLINE const LuaObject& key_at(uint32_t p_entry) const {
+            return layout->entries[p_entry].key;
+        }
+        template <typename Function>
+        GDRBLX_INLINE void foreach_live(Function p_function) const {
+            for (uint32_t i = 0; i < count; i++) {
+                if (Cell *cell = cell_at(i))
+                    p_function(key_at(i), cell);
+            }
+        }
+        // Moves the live entries to a new layout with room for one more, under write_lock.
+        // The old one is still used by the published version, publish() retires it.
+        void rebuild() {
+            Layout *next = memnew(Layout(Layout::capacity_for((count - dead + 1) * 2)));
+            for (uint32_t i = 0; i < count; i++) {
+                Cell *cell = cell_at(i);
+                if (cell != nullptr)
+                    next->append(key_at(i), cell);
+            }
+            layout = next;
+            count = next->used;
+            dead = 0;
+        }
+        // p_key must not be present.
+        void insert(const LuaObject& p_key, Cell *p_cell) {
+            const int64_t i = find_entry(p_key);
+            if (i >= 0) {
+                layout->entries[i].cell.store(p_cell, std::memory_order_release);
+                dead--;
+            } else {
+                if (count != layout->used || count == layout->capacity || (dead > 0 && dead * 2 >= count))
+                    rebuild(); // full, or compacting away the removed keys.
+                layout->append(p_key, p_cell);
+                count = layout->used;
+            }
+            if (LuaTable::array_index(p_key) == (int64_t)border) {
+                border++;
+                while (find(LuaObject((lua_Integer)(border + 1))) != nullptr)
+                    border++;
+            }
+        }
+        Cell* remove(const LuaObject& p_key) {
+            const int64_t i = find_entry(p_key);
+            if (i < 0)
+                return nullptr;
+            Cell *cell = cell_at(i);
+            if (cell == nullptr)
+                return nullptr;
+            layout->entries[i].cell.store(nullptr, std::memory_order_release);
+            dead++;
+            const int64_t a = LuaTable::array_index(p_key);
+            if (a >= 0 && a < (int64_t)border)
+                border = (uint32_t)a;
+            return cell;
+        }
+    };
+
+    std::atomic<Version*> current;
+    mutable std::mutex write_lock;
+
+    GDRBLX_INLINE const Version* load() const {
+        return current.load(std::memory_order_acquire);
+    }
+    // Nil for a cell removed since the version was loaded.
+    GDRBLX_INLINE static LuaObject value_of(const Cell *p_cell) {
+        return p_cell != nullptr ? decode(p_cell->word.load(std::memory_order_acquire)) : LuaObject();
+    }
+    static Version* build(const LuaTable& p_table) {
+        Version *v = memnew(Version(Layout::capacity_for(p_table.size() * 2))); // never rebuilt while filled.
+        p_table.foreach([v](const LuaObject& k, const LuaObject& val) {
+            v->insert(k, memnew(Cell(val.clone_or_share())));
+        });
+        return v;
+    }
+    LuaTable clone_of(const Version *p_version) const {
+        LuaTable t;
+        p_version->foreach_live([&t](const LuaObject& k, const Cell *cell) {
+            t.set(k, value_of(cell));
+        });
+        return t;
+    }
+
+    // The rest runs under write_lock, inside an EpochGuard when boxes are read.
+    // Replaced data is retired only after the new version is visible.
+    GDRBLX_INLINE void publish(Version *p_version) {
+        Version *old = current.exchange(p_version, std::memory_order_acq_rel);
+        if (old->layout != p_version->layout) // older versions on it were retired before.
+            internal::EpochDomain::retire(old->layout);
+        internal::EpochDomain::retire(old);
+    }
+    // Fails if a lock-free writer changed the word since p_expected was loaded.
+    static bool try_mark_moved(Cell *p_cell, uint64_t p_expected) {
+        const uint64_t moved = is_number(p_expected) ? box_word(memnew(Box(LuaObject(to_number(p_expected)))), MOVED_TAG) : p_expected | MOVED_TAG;
+        if (p_cell->word.compare_exchange_strong(p_expected, moved, std::memory_order_acq_rel))
+            return true;
+        if (is_number(p_expected))
+            ::godot::memdelete(box_of(moved));
+        return false;
+    }
+    static void mark_moved(Cell *p_cell) {
+        uint64_t word = p_cell->word.load(std::memory_order_acquire);
+        while (!try_mark_moved(p_cell, word))
+            ; // word was reloaded by the failed exchange.
+    }
+    // Cells of the current version must all be marked moved already.
+    void publish_replacing_all(Version *p_version) {
+        CellBatch *batch = memnew(CellBatch);
+        load()->foreach_live([batch](const LuaObject&, Cell *cell) {
+            batch->cells.push_back(cell);
+        });
+        publish(p_version);
+        internal::EpochDomain::retire(batch);
+    }
+    void set_locked(const LuaObject& p_key, const LuaObject& p_value) {
+        const Version *v = load();
+        ERR_FAIL_COND_MSG(v->frozen, "Cannot modify a frozen SharedTable.");
+        Cell *cell = v->find(p_key);
+        const bool remove = p_value.is_null();
+        if (cell != nullptr && !remove) { // same layout, only the value changes.
+            retire_word(cell->word.exchange(encode(p_value), std::memory_order_acq_rel));
+            return;
+        }
+        if (cell == nullptr && remove)
+            return;
+        Version *next = memnew(Version(*v));
+        if (remove) {
+            mark_moved(cell);
+            next->remove(p_key);
+            publish(next);
+            internal::EpochDomain::retire(cell);
+            return;
+        }
+        next->insert(p_key, memnew(Cell(p_value)));
+        publish(next);
+    }
+    // Bulk operations go through a LuaTable copy and publish it as a whole. The copy is
+    // validated against lock-free writers when the old cells are marked, and redone if one got in.
+    template <typename Function>
+    GDRBLX_INLINE auto modify(Function p_function) {
+        std::lock_guard guard(write_lock);
+        internal::EpochGuard epoch;
+        const Version *v = load();
+        LocalVec<uint64_t> seen;
+        while (true) {
+            LuaTable t;
+            LocalVec<Cell*> cells;
+            seen.clear();
+            v->foreach_live([&](const LuaObject& k, Cell *cell) {
+                cells.push_back(cell);
+                seen.push_back(cell->word.load(std::memory_order_acquire));
+                t.set(k, decode(seen[seen.size() - 1]));
+            });
+            if (v->frozen)
+                t.freeze(); // fails the same way a frozen LuaTable does.
+            auto result = p_function(t);
+            uint32_t marked = 0;
+            while (marked < cells.size() && try_mark_moved(cells[marked], seen[marked]))
+                marked++;
+            if (marked == seen.size()) {
+                Version *next = build(t);
+                next->frozen = v->frozen;
+                publish_replacing_all(next);
+                return result;
+            }
+            for (uint32_t j = 0; j < marked; j++) {
+                // readers may hold the box made for a number.
+                const uint64_t moved = cells[j]->word.exchange(seen[j], std::memory_order_acq_rel);
+                if (is_number(seen[j]))
+                    internal::EpochDomain::retire(box_of(moved));
+            }
+        }
+    }
+
+public:
+    struct SharedTableIteration {
         friend class SharedTable;
-        LuaIpairsIteratorThreaded(const LuaTable* p_t) : LuaIpairsIterator(p_t) {}
-        LuaIpairsIteratorThreaded(const LuaTable* p_t, lua_Integer p_start) : LuaIpairsIterator(p_t, p_start) {}
+        LuaObject key;
+        LuaObject value;
+        GDRBLX_INLINE bool valid() const { return cursor != 0; }
+    private:
+        size_t cursor = 0; // entry slot + 1, it survives later writes to the same layout.
+        uint64_t layout = 0; // id of that layout.
+    };
+    class SharedPairsIterator {
+        friend class SharedTable;
+        const SharedTable *t;
+        SharedTableIteration it;
+        SharedPairsIterator(const SharedTable *p_t) : t(p_t), it(p_t->next()) {}
     public:
-        GDRBLX_INLINE LuaIpairsIterator& operator++() override {
-            dynamic_cast<const SharedTable*>(t)->lock.lock_shared();
-            LuaIpairsIterator::operator++();
-            dynamic_cast<const SharedTable*>(t)->lock.unlock_shared();
+        GDRBLX_INLINE bool valid() const { return it.valid(); }
+
+        GDRBLX_INLINE const SharedTableIteration& operator*() const {
+            return it;
+        }
+        GDRBLX_INLINE const SharedTableIteration* operator->() const {
+            return &it;
+        }
+        GDRBLX_INLINE SharedPairsIterator& operator++() {
+            it = t->next(it);
             return *this;
         }
     };
+    class SharedIpairsIterator {
+        friend class SharedTable;
+        const SharedTable *t;
+        SharedTableIteration it;
+        GDRBLX_INLINE void seek(lua_Integer p_idx) {
+            it.key = p_idx;
+            it.value = t->get(it.key);
+            it.cursor = it.value.is_null() ? 0 : (size_t)p_idx;
+        }
+        SharedIpairsIterator(const SharedTable *p_t, lua_Integer p_start) : t(p_t) {
+            seek(p_start);
+        }
+    public:
+        GDRBLX_INLINE bool valid() const { return it.valid(); }
 
-public:
-    SharedTable() : LuaTable() {}
-    SharedTable(const LuaTable& p_t) : LuaTable(p_t) {}
-    SharedTable(const LuaTable&& p_t) : LuaTable(p_t) {}
+        GDRBLX_INLINE const SharedTableIteration& operator*() const {
+            return it;
+        }
+        GDRBLX_INLINE const SharedTableIteration* operator->() const {
+            return &it;
+        }
+        GDRBLX_INLINE SharedIpairsIterator& operator++() {
+            if (it.valid())
+                seek((lua_Integer)it.cursor + 1);
+            return *this;
+        }
+    };
 
-    GDRBLX_INLINE const LuaObject& operator[](const LuaObject& p_key) const { return LuaTable::operator[](p_key); };
-    GDRBLX_INLINE internal::LuaTableProperty& operator[](const LuaObject& p_key) { return LuaTable::operator[](p_key); };
-    
-    GDRBLX_INLINE bool has(const LuaObject& p_key) const override {
-        lock.lock_shared();
-        const bool b = LuaTable::has(p_key);
-        lock.unlock_shared();
-        return b;
-    }
-    GDRBLX_INLINE const LuaObject& get(const LuaObject& p_key) const override {
-        lock.lock_shared();
-        const LuaObject& b = LuaTable::get(p_key);
-        lock.unlock_shared();
-        return b;
-    }
-    GDRBLX_INLINE void set(const LuaObject& p_key, const LuaObject& p_value) override {
-        lock.lock();
-        LuaTable::set(p_key, p_value);
-        lock.unlock();
-    }
-    GDRBLX_INLINE size_t size() const override {
-        lock.lock_shared();
-        const LuaObject& size = LuaTable::size();
-        lock.unlock_shared();
-        return size;
-    }
-    GDRBLX_INLINE size_t arr_len() const override {
-        lock.lock_shared();
-        const LuaObject& arr_len = LuaTable::arr_len();
-        lock.unlock_shared();
-        return arr_len;
-    }
-
-    GDRBLX_INLINE LuaTableIteration next() const override {
-        lock.lock_shared();
-        LuaTableIteration it = LuaTable::next();
-        lock.unlock_shared();
-        return std::move(it);
-    }
-    GDRBLX_INLINE LuaTableIteration next(const LuaObject& p_key) const override {
-        lock.lock_shared();
-        LuaTableIteration it = LuaTable::next(p_key);
-        lock.unlock_shared();
-        return std::move(it);
-    }
-    GDRBLX_INLINE LuaTableIteration next(const LuaTableIteration& p_last) const override {
-        lock.lock_shared();
-        LuaTableIteration it = LuaTable::next(p_last);
-        lock.unlock_shared();
-        return std::move(it);
-    }
-    GDRBLX_INLINE LuaPairsIterator pairs() const override {
-        lock.lock_shared();
-        LuaPairsIterator it = LuaTable::pairs();
-        lock.unlock_shared();
-        return std::move(it);
-    }
-    GDRBLX_INLINE LuaIpairsIterator ipairs() const override {
-        lock.lock_shared();
-        LuaIpairsIterator it = LuaIpairsIteratorThreaded(this);
-        lock.unlock_shared();
-        return std::move(it);
-    }
-    GDRBLX_INLINE LuaIpairsIterator ipairs(lua_Integer p_start) const override {
-        lock.lock_shared();
-        LuaIpairsIterator it = LuaIpairsIteratorThreaded(this, p_start);
-        lock.unlock_shared();
-        return std::move(it);
+    SharedTable() : current(memnew(Version)) {}
+    SharedTable(const LuaTable& p_t) : current(build(p_t)) {
+        current.load(std::memory_order_relaxed)->frozen = p_t.isfrozen();
     }
-    
+    SharedTable(LuaTable&& p_t) : SharedTable((const LuaTable&)p_t) {}
+    SharedTable(const SharedTable& p_other) : SharedTable(p_other.clone()) {
+        current.load(std::memory_order_relaxed)->frozen = p_other.isfrozen();
+    }
+    SharedTable(SharedTable&& p_other) : current(p_other.current.exchange(memnew(Version), std::memory_order_acq_rel)) {}
+    ~SharedTable() {
+        Version *v = current.load(std::memory_order_acquire);
+        v->foreach_live([](const LuaObject&, Cell *cell) {
+            ::godot::memdelete(cell);
+        });
+        ::godot::memdelete(v->layout);
+        ::godot::memdelete(v);
+    }
+    SharedTable& operator=(const SharedTable&) = delete;
 
-    GDRBLX_INLINE void clear() override {
-        lock.lock();
-        LuaTable::clear();
-        lock.unlock();
-    }
-    template <typename T = LuaTable>
-    GDRBLX_INLINE T clone() const {
-        static_assert(std::is_base_of_v<LuaTable, T> || std::is_same_v<LuaTable, T>, "T must be LuaTable or derived.");
-        lock.lock_shared();
-        T t = LuaTable::clone();
-        lock.unlock_shared();
-        return std::move(t);
+    GDRBLX_INLINE LuaObject operator[](const LuaObject& p_key) const {
+        return get(p_key);
+    }
+    GDRBLX_INLINE bool has(const LuaObject& p_key) const {
+        internal::EpochGuard guard;
+        return load()->find(p_key) != nullptr;
+    }
+    GDRBLX_INLINE LuaObject get(const LuaObject& p_key) const {
+        internal::EpochGuard guard;
+        const Cell *cell = load()->find(p_key);
+        return cell != nullptr ? value_of(cell) : LuaObject();
+    }
+    // Values are stored like clone_or_share, other states and threads read them too.
+    GDRBLX_INLINE void set(const LuaObject& p_key, const LuaObject& p_value) {
+        const LuaObject value = p_value.clone_or_share();
+        std::lock_guard guard(write_lock);
+        set_locked(p_key, value);
+    }
+    // Adds p_delta to the number at p_key and returns the number it held, like
+    // SharedTable.increment. One compare-exchange on the cell, the key must already exist.
+    LuaObject increment(const LuaObject& p_key, lua_Number p_delta) {
+        internal::EpochGuard guard;
+        while (true) {
+            const Version *v = load();
+            ERR_FAIL_COND_V_MSG(v->frozen, LuaObject(), "Cannot modify a frozen SharedTable.");
+            Cell *cell = v->find(p_key);
+            ERR_FAIL_NULL_V_MSG(cell, LuaObject(), "SharedTable.increment on a key that is not present.");
+            uint64_t word = cell->word.load(std::memory_order_acquire);
+            while (!is_moved(word)) {
+                const LuaObject old = decode(word);
+                ERR_FAIL_COND_V_MSG(old.type != LuaObject::NUMBER && old.type != LuaObject::INTEGER, LuaObject(), "SharedTable.increment on a value that is not a number.");
+                const uint64_t next = encode_number((old.type == LuaObject::INTEGER ? (lua_Number)old.integer : old.number) + p_delta);
+                if (cell->word.compare_exchange_weak(word, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    retire_word(word);
+                    return old;
+                }
+                free_word(next); // never visible.
+            }
+            // a writer is replacing the cell, its new version is published right after.
+        }
+    }
+    // Replaces the value at p_key with p_function(old value), like SharedTable.update.
+    // Optimistic, p_function runs without any lock and is called again if another writer
+    // changed the key in the meantime. Returning nil removes the key.
+    template <typename Function>
+    void update(const LuaObject& p_key, Function p_function) {
+        while (true) {
+            LuaObject old;
+            bool present;
+            {
+                internal::EpochGuard guard;
+                const Version *v = load();
+                ERR_FAIL_COND_MSG(v->frozen, "Cannot modify a frozen SharedTable.");
+                const Cell *cell = v->find(p_key);
+                present = cell != nullptr;
+                if (present) {
+                    const uint64_t word = cell->word.load(std::memory_order_acquire);
+                    if (is_moved(word))
+                        continue;
+                    old = decode(word);
+                }
+            }
+            // Outside of any guard, a script callback that raises never returns to close it.
+            const LuaObject result = p_function(old).clone_or_share();
+            internal::EpochGuard guard;
+            const Version *v = load();
+            ERR_FAIL_COND_MSG(v->frozen, "Cannot modify a frozen SharedTable.");
+            Cell *cell = v->find(p_key);
+            if ((cell != nullptr) != present)
+                continue;
+            uint64_t word = 0;
+            if (cell != nullptr) {
+                word = cell->word.load(std::memory_order_acquire);
+                if (!holds(word, old))
+                    continue;
+            }
+            if (cell != nullptr && !result.is_null()) {
+                const uint64_t next = encode(result);
+                if (cell->word.compare_exchange_strong(word, next, std::memory_order_acq_rel)) {
+                    retire_word(word);
+                    return;
+                }
+                free_word(next); // never visible.
+                continue;
+            }
+            // adding or removing the key changes the layout.
+            std::lock_guard lock(write_lock);
+            const Version *now = load();
+            Cell *now_cell = now->find(p_key);
+            if (now_cell != cell)
+                continue;
+            if (cell == nullptr) {
+                set_locked(p_key, result);
+                return;
+            }
+            if (now->frozen || !try_mark_moved(cell, word))
+                continue;
+            Version *next = memnew(Version(*now));
+            next->remove(p_key);
+            publish(next);
+            internal::EpochDomain::retire(cell);
+            return;
+        }
+    }
+    GDRBLX_INLINE size_t size() const {
+        internal::EpochGuard guard;
+        const Version *v = load();
+        return v->count - v->dead;
+    }
+    GDRBLX_INLINE size_t arr_len() const {
+        internal::EpochGuard guard;
+        return load()->border;
+    }
+
+    SharedTableIteration next() const {
+        return next(NIL_OBJECT_REF);
+    }
+    // The entry after p_key, like lua_next.
+    SharedTableIteration next(const LuaObject& p_key) const {
+        internal::EpochGuard guard;
+        const Version *v = load();
+        if (p_key.is_null())
+            return iteration_at(v, 0);
+        const int64_t i = v->find_entry(p_key);
+        return i >= 0 ? iteration_at(v, i + 1) : SharedTableIteration();
+    }
+    SharedTableIteration next(const SharedTableIteration& p_last) const {
+        if (!p_last.valid())
+            return p_last;
+        internal::EpochGuard guard;
+        const Version *v = load();
+        if (v->layout->id != p_last.layout) { // rebuilt, cleared or modified since, the slot moved.
+            const int64_t i = v->find_entry(p_last.key);
+            return i >= 0 ? iteration_at(v, i + 1) : SharedTableIteration();
+        }
+        return iteration_at(v, p_last.cursor);
+    }
+    GDRBLX_INLINE SharedPairsIterator pairs() const {
+        return SharedPairsIterator(this);
+    }
+    GDRBLX_INLINE SharedIpairsIterator ipairs(lua_Integer p_start = 1) const {
+        return SharedIpairsIterator(this, p_start);
+    }
+
+    GDRBLX_INLINE void clear() {
+        std::lock_guard guard(write_lock);
+        const Version *v = load();
+        ERR_FAIL_COND_MSG(v->frozen, "Cannot modify a frozen SharedTable.");
+        v->foreach_live([](const LuaObject&, Cell *cell) {
+            mark_moved(cell);
+        });
+        publish_replacing_all(memnew(Version));
+    }
+    GDRBLX_INLINE LuaTable clone() const {
+        internal::EpochGuard guard;
+        return clone_of(load());
     }
-    GDRBLX_INLINE LuaString concat(LuaString p_sep, lua_Integer p_i = 1) const { return LuaTable::concat(p_sep, p_i);}
-    GDRBLX_INLINE LuaString concat(LuaString p_sep, lua_Integer p_i, lua_Integer p_j) const { return LuaTable::concat(p_sep, p_i, p_j);}
+    GDRBLX_INLINE LuaString concat(LuaString p_sep, lua_Integer p_i = 1) const { return clone().concat(p_sep, p_i); }
+    GDRBLX_INLINE LuaString concat(LuaString p_sep, lua_Integer p_i, lua_Integer p_j) const { return clone().concat(p_sep, p_i, p_j); }
     GDRBLX_INLINE static SharedTable create(lua_Integer p_count, const LuaObject& p_value) {
         return SharedTable(LuaTable::create(p_count, p_value));
     }
-    GDRBLX_INLINE const LuaObject& find(const LuaObject& p_needle, lua_Integer p_init = 1) const { return LuaTable::find(p_needle, p_init); }
-    template <typename Function> 
-    GDRBLX_INLINE void foreach(Function p_function) const { return LuaTable::foreach(p_function); }
-    template <typename Function> 
-    GDRBLX_INLINE void foreachi(Function p_function) const { return LuaTable::foreachi(p_function); }
-    GDRBLX_INLINE void freeze() override {
-        lock.lock();
-        LuaTable::freeze();
-        lock.unlock();
-    }
-    GDRBLX_INLINE void unfreeze() override {
-        lock.lock();
-        LuaTable::unfreeze();
-        lock.unlock();
-    }
-    GDRBLX_INLINE lua_Integer getn() const { return LuaTable::getn(); }
-    GDRBLX_INLINE void insert(lua_Integer p_pos, const LuaObject& p_value) { return LuaTable::insert(p_pos, p_value); }
-    GDRBLX_INLINE void insert(const LuaObject& p_value) {return LuaTable::insert(p_value); }
-    GDRBLX_INLINE bool isfrozen() const override {
-        lock.lock_shared();
-        bool b = LuaTable::isfrozen();
-        lock.unlock_shared();
-        return b;
-    }
-    GDRBLX_INLINE lua_Number maxn() const { return LuaTable::maxn(); }
-    GDRBLX_INLINE LuaTable& move(const LuaTable& p_src, lua_Integer p_a, lua_Integer p_b, lua_Integer p_t) { return LuaTable::move(p_src, p_a, p_b, p_t); }
-    GDRBLX_INLINE LuaObject remove(lua_Integer p_pos) { return LuaTable::remove(p_pos); }
-    GDRBLX_INLINE void sort() { return LuaTable::sort(); }
+    GDRBLX_INLINE LuaObject find(const LuaObject& p_needle, lua_Integer p_init = 1) const {
+        internal::EpochGuard guard;
+        const Version *v = load();
+        for (lua_Integer i = p_init; i >= 1 && i <= (lua_Integer)v->border; i++) {
+            if (value_of(v->find(i)) == p_needle)
+                return i;
+        }
+        return LuaObject();
+    }
+    // p_function sees the keys of one version, minus those removed while it runs.
+    template <typename Function>
+    GDRBLX_INLINE void foreach(Function p_function) const {
+        internal::EpochGuard guard;
+        load()->foreach_live([&p_function](const LuaObject& k, const Cell *cell) {
+            p_function(k, value_of(cell));
+        });
+    }
+    template <typename Function>
+    GDRBLX_INLINE void foreachi(Function p_function) const {
+        internal::EpochGuard guard;
+        const Version *v = load();
+        for (lua_Integer i = 1; i <= (lua_Integer)v->border; i++)
+            p_function(LuaObject(i), value_of(v->find(i)));
+    }
+    GDRBLX_INLINE void freeze() {
+        std::lock_guard guard(write_lock);
+        Version *next = memnew(Version(*load()));
+        next->frozen = true;
+        publish(next);
+    }
+    GDRBLX_INLINE void unfreeze() {
+        std::lock_guard guard(write_lock);
+        Version *next = memnew(Version(*load()));
+        next->frozen = false;
+        publish(next);
+    }
+    GDRBLX_INLINE bool isfrozen() const {
+        internal::EpochGuard guard;
+        return load()->frozen;
+    }
+    GDRBLX_INLINE lua_Integer getn() const { return size(); }
+    GDRBLX_INLINE void insert(lua_Integer p_pos, const LuaObject& p_value) {
+        modify([&](LuaTable& t) { t.insert(p_pos, p_value); return true; });
+    }
+    GDRBLX_INLINE void insert(const LuaObject& p_value) {
+        const LuaObject value = p_value.clone_or_share();
+        std::lock_guard guard(write_lock);
+        set_locked((lua_Integer)(load()->border + 1), value);
+    }
+    GDRBLX_INLINE lua_Number maxn() const { return clone().maxn(); }
+    GDRBLX_INLINE SharedTable& move(const LuaTable& p_src, lua_Integer p_a, lua_Integer p_b, lua_Integer p_t) {
+        modify([&](LuaTable& t) { t.move(p_src, p_a, p_b, p_t); return true; });
+        return *this;
+    }
+    GDRBLX_INLINE LuaObject remove(lua_Integer p_pos) {
+        return modify([&](LuaTable& t) { return t.remove(p_pos); });
+    }
+    GDRBLX_INLINE void sort() {
+        modify([](LuaTable& t) { t.sort(); return true; });
+    }
     template <typename Comparator>
-    GDRBLX_INLINE void sort(Comparator comparator) { return LuaTable::sort(comparator); }
+    GDRBLX_INLINE void sort(Comparator comparator) {
+        modify([&](LuaTable& t) { t.sort(comparator); return true; });
+    }
+    // Errors never leave modify, the lock and the guard are released before the caller raises it.
+    GDRBLX_INLINE bool sort(lua_State *p_L, const LuaObject& p_comparator, LuaObject& r_error) {
+        return modify([&](LuaTable& t) { return t.sort(p_L, p_comparator, r_error); });
+    }
+private:
+    SharedTableIteration iteration_at(const Version *p_version, size_t p_slot) const {
+        SharedTableIteration it;
+        for (size_t i = p_slot; i < p_version->count; i++) {
+            const Cell *cell = p_version->cell_at(i);
+            if (cell == nullptr)
+                continue;
+            it.key = p_version->key_at(i);
+            it.value = value_of(cell);
+            it.cursor = i + 1;
+            it.layout = p_version->layout->id;
+            break;
+        }
+        return it;
+    }
 }; // class SharedTable
 
 } // namespace gdrblx
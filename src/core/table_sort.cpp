@@ -0,0 +1,320 @@
+#include "table.hpp"
+
+#include <algorithm>
+
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
+
+#include "string.hpp"
+
+namespace gdrblx {
+
+static constexpr uint32_t PARALLEL_SORT_THRESHOLD = 1 << 15; // below it the pool costs more than it saves.
+static constexpr uint32_t MIN_PARALLEL_RUN = 1 << 13;
+
+struct LuaTable::Sort {
+    enum Kind {
+        NUMBERS,
+        STRINGS,
+        OTHER
+    };
+
+    GDRBLX_INLINE static lua_Number number(const LuaObject& p_value) {
+        return p_value.type == LuaObject::INTEGER ? (lua_Number)p_value.integer : p_value.number;
+    }
+    // NaN is no strict weak order, such arrays take the generic comparison like before.
+    static Kind classify(const LocalVec<LuaObject>& p_array) {
+        bool numbers = true;
+        bool strings = true;
+        for (const LuaObject& v : p_array) {
+            numbers = numbers && (v.type == LuaObject::INTEGER || (v.type == LuaObject::NUMBER && v.number == v.number));
+            strings = strings && v.type == LuaObject::STRING;
+            if (!numbers && !strings)
+                return OTHER;
+        }
+        return numbers ? NUMBERS : STRINGS;
+    }
+
+    struct NumberLess {
+        GDRBLX_INLINE bool operator()(const LuaObject& a, const LuaObject& b) const {
+            return number(a) < number(b);
+        }
+    };
+    // Byte order, shorter first on a common prefix, like Luau's string comparison.
+    struct StringLess {
+        GDRBLX_INLINE bool operator()(const LuaObject& a, const LuaObject& b) const {
+            const internal::LuaStringData *x = a.str;
+            const internal::LuaStringData *y = b.str;
+            if (x == y)
+                return false;
+            const int c = memcmp(x->data, y->data, std::min(x->len, y->len));
+            return c < 0 || (c == 0 && x->len < y->len);
+        }
+    };
+    static bool generic_less(void *, const LuaObject& a, const LuaObject& b) {
+        return (bool)(a < b);
+    }
+
+    struct ScriptLess {
+        lua_State *L;
+        LuaObject lt; // nil for the < operator.
+        LuaObject error;
+        bool failed = false;
+    };
+    static int lua_less(lua_State *L) {
+        lua_pushboolean(L, lua_lessthan(L, 1, 2));
+        return 1;
+    }
+    // Never raises, the first error is kept and every later comparison is false.
+    static bool script_less(void *p_less, const LuaObject& a, const LuaObject& b) {
+        ScriptLess *self = (ScriptLess*)p_less;
+        if (self->failed)
+            return false;
+        lua_State *L = self->L;
+        if (self->lt.is_null())
+            lua_pushcfunction(L, &lua_less, "LuaTable::sort");
+        else
+            self->lt.push(L);
+        LuaObject(a).push(L);
+        LuaObject(b).push(L);
+        if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+            self->error = LuaObject::convert(L, -1);
+            self->failed = true;
+            lua_pop(L, 1);
+            return false;
+        }
+        const bool less = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+        return less;
+    }
+
+    // Quicksort after Luau's auxsort. Values only ever trade places and the partition scans stop
+    // at the pivot's neighbours, which a consistent order never passes.
+    struct Checked {
+        SortLess less;
+        void *comparator;
+        const bool *failed;
+
+        GDRBLX_INLINE bool lt(const LuaObject& a, const LuaObject& b) const {
+            return less(comparator, a, b);
+        }
+        // Sorts p_data[l..u], false once the order turned out to be invalid.
+        bool sort(LuaObject *p_data, uint32_t l, uint32_t u) const {
+            while (l < u) {
+                if (failed != nullptr && *failed)
+                    return false;
+                if (lt(p_data[u], p_data[l]))
+                    std::swap(p_data[l], p_data[u]);
+                if (u - l == 1)
+                    return true;
+                const uint32_t m = l + (u - l) / 2;
+                if (lt(p_data[m], p_data[l]))
+                    std::swap(p_data[m], p_data[l]);
+                else if (lt(p_data[u], p_data[m]))
+                    std::swap(p_data[m], p_data[u]);
+                if (u - l == 2)
+                    return true;
+                const LuaObject pivot = p_data[m];
+                std::swap(p_data[m], p_data[u - 1]); // p_data[l] <= pivot == p_data[u - 1] <= p_data[u]
+                uint32_t i = l;
+                uint32_t j = u - 1;
+                while (true) {
+                    while (lt(p_data[++i], pivot)) {
+                        if (i >= u - 1)
+                            return false;
+                    }
+                    while (lt(pivot, p_data[--j])) {
+                        if (j <= l)
+                            return false;
+                    }
+                    if (j < i)
+                        break;
+                    std::swap(p_data[i], p_data[j]);
+                }
+                std::swap(p_data[u - 1], p_data[i]);
+                if (i - l < u - i) { // recursing into the smaller part bounds the depth.
+                    if (!sort(p_data, l, i - 1))
+                        return false;
+                    l = i + 1;
+                } else {
+                    if (!sort(p_data, i + 1, u))
+                        return false;
+                    u = i - 1;
+                }
+            }
+            return true;
+        }
+        // Merge sort on a copy, the array is only replaced once it finished. Merging stays
+        // within its runs whatever the order says.
+        void stable_sort(LocalVec<LuaObject>& r_array) const {
+            static constexpr uint32_t RUN = 8;
+            const uint32_t n = r_array.size();
+            LocalVec<LuaObject> src = r_array;
+            LocalVec<LuaObject> dst;
+            dst.resize(n);
+            for (uint32_t begin = 0; begin < n; begin += RUN) {
+                const uint32_t end = std::min(begin + RUN, n);
+                for (uint32_t i = begin + 1; i < end; i++) {
+                    for (uint32_t j = i; j > begin && lt(src[j], src[j - 1]); j--)
+                        std::swap(src[j], src[j - 1]);
+                }
+            }
+            for (uint32_t width = RUN; width < n; width *= 2) {
+                for (uint32_t begin = 0; begin < n; begin += 2 * width) {
+                    const uint32_t mid = std::min(begin + width, n);
+                    const uint32_t end = std::min(mid + width, n);
+                    uint32_t a = begin;
+                    uint32_t b = mid;
+                    uint32_t out = begin;
+                    while (a < mid && b < end)
+                        dst[out++] = std::move(lt(src[b], src[a]) ? src[b++] : src[a++]);
+                    while (a < mid)
+                        dst[out++] = std::move(src[a++]);
+                    while (b < end)
+                        dst[out++] = std::move(src[b++]);
+                }
+                std::swap(src, dst);
+            }
+            r_array = std::move(src);
+        }
+    };
+
+    template <typename Less>
+    GDRBLX_INLINE static void sort_run(LuaObject *p_begin, LuaObject *p_end, bool p_stable) {
+        if (p_stable)
+            std::stable_sort(p_begin, p_end, Less());
+        else
+            std::sort(p_begin, p_end, Less());
+    }
+
+    // Runs are sorted in parallel, then merged pairwise between the array and a scratch buffer.
+    // LuaObject is relocatable, so merging copies raw bytes and never touches a refcount.
+    // Only used with the comparisons above that do not run script code.
+    template <typename Less>
+    struct ParallelMerge {
+        LuaObject *data;
+        LuaObject *src;
+        LuaObject *dst;
+        uint32_t count;
+        uint32_t width;
+        bool stable;
+
+        GDRBLX_INLINE static void relocate(LuaObject *p_to, const LuaObject *p_from, uint32_t p_count) {
+            memcpy((void*)p_to, (const void*)p_from, p_count * sizeof(LuaObject));
+        }
+        static void sort_chunk(void *p_self, uint32_t p_index) {
+            ParallelMerge *self = (ParallelMerge*)p_self;
+            const uint32_t begin = p_index * self->width;
+            const uint32_t end = std::min(begin + self->width, self->count);
+            sort_run<Less>(self->data + begin, self->data + end, self->stable);
+        }
+        // Takes from the left run on ties, which keeps the merge stable.
+        static void merge_pair(void *p_self, uint32_t p_index) {
+            ParallelMerge *self = (ParallelMerge*)p_self;
+            const uint32_t begin = p_index * 2 * self->width;
+            const uint32_t mid = std::min(begin + self->width, self->count);
+            const uint32_t end = std::min(mid + self->width, self->count);
+            const LuaObject *a = self->src + begin;
+            const LuaObject *a_end = self->src + mid;
+            const LuaObject *b = self->src + mid;
+            const LuaObject *b_end = self->src + end;
+            LuaObject *out = self->dst + begin;
+            const Less less;
+            while (a != a_end && b != b_end) {
+                if (less(*b, *a))
+                    relocate(out++, b++, 1);
+                else
+                    relocate(out++, a++, 1);
+            }
+            relocate(out, a, a_end - a);
+            relocate(out + (a_end - a), b, b_end - b);
+        }
+
+        static void run(LuaObject *p_data, uint32_t p_count, bool p_stable) {
+            ::godot::WorkerThreadPool *pool = ::godot::WorkerThreadPool::get_singleton();
+            const uint32_t tasks = std::min((uint32_t)::godot::OS::get_singleton()->get_processor_count(), p_count / MIN_PARALLEL_RUN);
+            if (tasks < 2) {
+                sort_run<Less>(p_data, p_data + p_count, p_stable);
+                return;
+            }
+            // Raw bytes, objects are only ever relocated into it and back.
+            LuaObject *scratch = (LuaObject*)memalloc(p_count * sizeof(LuaObject));
+            ParallelMerge self{ p_data, p_data, scratch, p_count, (p_count + tasks - 1) / tasks, p_stable };
+            const uint32_t chunks = (p_count + self.width - 1) / self.width;
+            pool->wait_for_group_task_completion(pool->add_native_group_task(&sort_chunk, &self, chunks, chunks, true, "LuaTable sort"));
+            while (self.width < p_count) {
+                const uint32_t pairs = (p_count + 2 * self.width - 1) / (2 * self.width);
+                if (pairs == 1)
+                    merge_pair(&self, 0);
+                else
+                    pool->wait_for_group_task_completion(pool->add_native_group_task(&merge_pair, &self, pairs, pairs, true, "LuaTable sort"));
+                std::swap(self.src, self.dst);
+                self.width *= 2;
+            }
+            if (self.src != p_data)
+                relocate(p_data, self.src, p_count);
+            memfree(scratch);
+        }
+    };
+
+    template <typename Less>
+    static void sort_values(LocalVec<LuaObject>& p_array, bool p_stable) {
+        if (p_array.size() >= PARALLEL_SORT_THRESHOLD)
+            ParallelMerge<Less>::run(p_array.ptr(), p_array.size(), p_stable);
+        else
+            sort_run<Less>(p_array.ptr(), p_array.ptr() + p_array.size(), p_stable);
+    }
+
+    static void sort(LuaTable *p_table, bool p_stable) {
+        DEV_ASSERT(!p_table->frozen);
+        ERR_FAIL_COND(p_table->frozen);
+        switch (classify(p_table->array)) {
+            case NUMBERS:
+                sort_values<NumberLess>(p_table->array, p_stable);
+                break;
+            case STRINGS:
+                sort_values<StringLess>(p_table->array, p_stable);
+                break;
+            case OTHER: // metamethods may run script code, single threaded and frozen.
+                p_table->begin_sort();
+                p_table->sort_checked(&generic_less, nullptr, p_stable);
+                p_table->end_sort();
+                break;
+        }
+    }
+};
+
+void LuaTable::sort() {
+    Sort::sort(this, false);
+}
+
+void LuaTable::stable_sort() {
+    Sort::sort(this, true);
+}
+
+void LuaTable::sort_checked(SortLess p_less, void *p_comparator, bool p_stable, const bool *p_failed) {
+    const Sort::Checked checked{ p_less, p_comparator, p_failed };
+    if (p_stable) {
+        checked.stable_sort(array);
+        return;
+    }
+    if (array.size() > 1 && !checked.sort(array.ptr(), 0, array.size() - 1))
+        ERR_FAIL_COND_MSG(p_failed == nullptr || !*p_failed, "invalid order function for sorting");
+}
+
+bool LuaTable::sort(lua_State *p_L, const LuaObject& p_comparator, LuaObject& r_error, bool p_stable) {
+    if (frozen) {
+        r_error = LuaObject("attempt to modify a readonly table");
+        return false;
+    }
+    Sort::ScriptLess less{ p_L, p_comparator };
+    begin_sort();
+    sort_checked(&Sort::script_less, &less, p_stable, &less.failed);
+    end_sort();
+    if (!less.failed)
+        return true;
+    r_error = less.error;
+    return false;
+}
+
+} // namespace gdrblx
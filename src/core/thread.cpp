@@ -0,0 +1,49 @@
+#include "thread.hpp"
+
+#include "state.hpp"
+
+namespace gdrblx {
+
+internal::LuauThreadData* LuaThread::get_thread_data(lua_State *p_L) const {
+    lua_State* thr = nullptr;
+    if (native.type == LuaObject::LOCAL) { // already on a stack.
+        thr = lua_tothread(native.local_stack_coro, native.aux);
+    } else {
+        if (!native.knows_luau_state())
+            return nullptr;
+        LuauState* state = native.get_luau_state();
+        if (p_L == nullptr)
+            p_L = state->L;
+        ERR_FAIL_COND_V(LuauState::from_lua_state(p_L) != state, nullptr);
+        native.push_to_stack(state, p_L);
+        thr = lua_tothread(p_L, -1);
+        lua_pop(p_L, 1);
+    }
+    if (thr == nullptr)
+        return nullptr;
+    return LuauState::get_thread_data(thr);
+}
+
+ThreadIdentity* LuaThread::get_identity(lua_State *p_L) const {
+    internal::LuauThreadData* data = get_thread_data(p_L);
+    return data != nullptr ? data->identity : nullptr;
+}
+
+void LuaThread::set_identity(lua_State *p_L, ThreadIdentity* p_iden) {
+    internal::LuauThreadData* data = get_thread_data(p_L);
+    ERR_FAIL_NULL(data);
+    data->identity = p_iden;
+}
+
+LuaObject LuaThread::get_script_object(lua_State *p_L) const {
+    internal::LuauThreadData* data = get_thread_data(p_L);
+    return data != nullptr ? data->script : NIL_OBJECT_REF;
+}
+
+void LuaThread::set_script(lua_State *p_L, const LuaObject& p_script) {
+    internal::LuauThreadData* data = get_thread_data(p_L);
+    ERR_FAIL_NULL(data);
+    data->script = p_script;
+}
+
+} // namespace gdrblx
@@ -10,6 +10,8 @@
 namespace gdrblx {
 
 class BaseScript;
+class LuauState;
+class Actor;
 
 class ThreadIdentity {
 public:
@@ -19,11 +21,26 @@ public:
     }
 };
 
+namespace internal {
+
+// Stored on every coroutine through lua_setthreaddata, filled in LuauState::userthread.
+// Lets C functions reach their state, identity and script without registry lookups.
+struct LuauThreadData {
+    LuauState *state = nullptr;
+    Actor *actor = nullptr;
+    ThreadIdentity *identity = nullptr;
+    LuaObject script;
+    void *native_frame = nullptr; // innermost LuaNativeTask frame, see native_coroutine_step.
+};
+
+} // namespace internal
+
 class LuaThread {
     friend class LuaObject;
     friend class LuauCtx;
     LuaObject native;
     LuaThread(const LuaObject& p_native, int _) : native(p_native) {}
+    internal::LuauThreadData* get_thread_data(lua_State *p_L) const;
 public:
     LuaThread(const LuaObject& p_native) : native(p_native) {
         if (!p_native.is_type(LuaObject::THREAD)) {
@@ -33,18 +50,23 @@ public:
     void close();
     int vm_state() const;
     lua_CoStatus status() const;
-    ThreadIdentity* get_identity() const;
+    // p_L is the calling thread, it must belong to the same state as this one.
+    // Without it the main thread of the state is used, only valid while holding the state.
+    ThreadIdentity* get_identity(lua_State *p_L = nullptr) const;
     Arc<BaseScript> get_script() const;
-    void set_identity(ThreadIdentity* p_iden);
-    GDRBLX_INLINE ThreadIdentityType get_identity_enum() const {
-        ThreadIdentity* iden = get_identity();
+    void set_identity(lua_State *p_L, ThreadIdentity* p_iden);
+    GDRBLX_INLINE void set_identity(ThreadIdentity* p_iden) { set_identity(nullptr, p_iden); }
+    LuaObject get_script_object(lua_State *p_L = nullptr) const;
+    void set_script(lua_State *p_L, const LuaObject& p_script);
+    GDRBLX_INLINE ThreadIdentityType get_identity_enum(lua_State *p_L = nullptr) const {
+        ThreadIdentity* iden = get_identity(p_L);
         if (iden == nullptr)
             return ThreadIdentityType::IDEN_ANON;
         else
             return iden->get_identity();
     }
-    GDRBLX_INLINE SecurityContext get_security() const {
-        return (SecurityContext)getSecurityContextForIdentity(get_identity_enum());
+    GDRBLX_INLINE SecurityContext get_security(lua_State *p_L = nullptr) const {
+        return (SecurityContext)getSecurityContextForIdentity(get_identity_enum(p_L));
     }
 
     template <typename... Args>
@@ -0,0 +1,187 @@
+#include "object.hpp"
+
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/packed_float32_array.hpp>
+#include <godot_cpp/variant/packed_float64_array.hpp>
+#include <godot_cpp/variant/packed_int32_array.hpp>
+#include <godot_cpp/variant/packed_int64_array.hpp>
+#include <godot_cpp/variant/string_name.hpp>
+
+#include "object_header.hpp"
+
+namespace gdrblx {
+
+static constexpr int MAX_VARIANT_DEPTH = 64; // nested containers, guards against cycles in Variants.
+
+template <typename T, typename Packed>
+static LuaTable packed_to_table(const Packed& p_array) {
+    LuaTable t;
+    const int64_t n = p_array.size();
+    const auto *src = p_array.ptr();
+    for (int64_t i = 0; i < n; i++)
+        t.set(LuaObject((lua_Integer)(i + 1)), LuaObject((T)src[i]));
+    return t;
+}
+
+static LuaObject variant_to_lua(const ::godot::Variant& p_var, int p_depth);
+
+static LuaTable array_to_table(const ::godot::Array& p_array, int p_depth) {
+    LuaTable t;
+    const int64_t n = p_array.size();
+    for (int64_t i = 0; i < n; i++)
+        t.set(LuaObject((lua_Integer)(i + 1)), variant_to_lua(p_array[i], p_depth + 1));
+    return t;
+}
+
+static LuaTable dictionary_to_table(const ::godot::Dictionary& p_dict, int p_depth) {
+    LuaTable t;
+    ::godot::Array keys = p_dict.keys();
+    const int64_t n = keys.size();
+    for (int64_t i = 0; i < n; i++) {
+        const ::godot::Variant key = keys[i];
+        LuaObject k = variant_to_lua(key, p_depth + 1);
+        if (k.is_null())
+            continue;
+        t.set(k, variant_to_lua(p_dict[key], p_depth + 1));
+    }
+    return t;
+}
+
+static LuaObject variant_to_lua(const ::godot::Variant& p_var, int p_depth) {
+    ERR_FAIL_COND_V_MSG(p_depth > MAX_VARIANT_DEPTH, LuaObject(), "Variant is nested too deep to convert.");
+    switch (p_var.get_type()) {
+        case ::godot::Variant::NIL:
+            return LuaObject();
+        case ::godot::Variant::BOOL:
+            return LuaObject((bool)p_var);
+        case ::godot::Variant::INT:
+            return LuaObject((int64_t)p_var);
+        case ::godot::Variant::FLOAT:
+            return LuaObject((double)p_var);
+        case ::godot::Variant::STRING:
+            return LuaObject((::godot::String)p_var);
+        case ::godot::Variant::STRING_NAME:
+            return LuaObject(::godot::String((::godot::StringName)p_var));
+        case ::godot::Variant::PACKED_BYTE_ARRAY:
+            return LuaObject(LuaBuffer((::godot::PackedByteArray)p_var));
+        case ::godot::Variant::PACKED_FLOAT32_ARRAY:
+            return LuaObject(packed_to_table<lua_Number>((::godot::PackedFloat32Array)p_var));
+        case ::godot::Variant::PACKED_FLOAT64_ARRAY:
+            return LuaObject(packed_to_table<lua_Number>((::godot::PackedFloat64Array)p_var));
+        case ::godot::Variant::PACKED_INT32_ARRAY:
+            return LuaObject(packed_to_table<lua_Integer>((::godot::PackedInt32Array)p_var));
+        case ::godot::Variant::PACKED_INT64_ARRAY: // through doubles values above 2^53 would round.
+            return LuaObject(packed_to_table<lua_Integer>((::godot::PackedInt64Array)p_var));
+        case ::godot::Variant::ARRAY:
+            return LuaObject(array_to_table((::godot::Array)p_var, p_depth));
+        case ::godot::Variant::DICTIONARY:
+            return LuaObject(dictionary_to_table((::godot::Dictionary)p_var, p_depth));
+        default:
+            ERR_FAIL_V_MSG(LuaObject(), ::godot::String("Cannot convert Variant of type ") + ::godot::Variant::get_type_name(p_var.get_type()) + " to a Lua value.");
+    }
+}
+
+// Tables converted so far. A table reached again is the same Array or Dictionary,
+// one still being converted has no value yet and means it contains itself.
+// Copies of stack tables are kept alive so their addresses are not reused meanwhile.
+struct VariantVisited {
+    HashMap<const LuaTable*, ::godot::Variant> tables;
+    LocalVec<LuaObject> copies;
+};
+
+static ::godot::Variant lua_to_variant(const LuaObject& p_obj, int p_depth, VariantVisited& r_visited);
+
+// Tables with keys 1..n only become Arrays, anything else a Dictionary.
+static ::godot::Variant table_to_variant(const LuaTable& p_table, int p_depth, VariantVisited& r_visited) {
+    if (const ::godot::Variant *seen = r_visited.tables.getptr(&p_table)) {
+        ERR_FAIL_COND_V_MSG(seen->get_type() == ::godot::Variant::NIL, ::godot::Variant(), "Table contains itself, cannot convert it to a Variant.");
+        return *seen;
+    }
+    r_visited.tables.insert(&p_table, ::godot::Variant());
+    ::godot::Variant result;
+    const size_t n = p_table.arr_len();
+    if (n == p_table.size()) {
+        ::godot::Array array;
+        array.resize(n);
+        for (size_t i = 0; i < n; i++)
+            array[i] = lua_to_variant(p_table.get(LuaObject((lua_Integer)(i + 1))), p_depth + 1, r_visited);
+        result = array;
+    } else {
+        ::godot::Dictionary dict;
+        p_table.foreach([&dict, p_depth, &r_visited](const LuaObject& k, const LuaObject& v) {
+            dict[lua_to_variant(k, p_depth + 1, r_visited)] = lua_to_variant(v, p_depth + 1, r_visited);
+        });
+        result = dict;
+    }
+    r_visited.tables[&p_table] = result;
+    return result;
+}
+
+static ::godot::Variant lua_to_variant(const LuaObject& p_obj, int p_depth, VariantVisited& r_visited) {
+    ERR_FAIL_COND_V_MSG(p_depth > MAX_VARIANT_DEPTH, ::godot::Variant(), "Table is nested too deep to convert.");
+    switch (p_obj.get_type()) {
+        case LuaObject::NIL:
+            return ::godot::Variant();
+        case LuaObject::BOOLEAN:
+            return (bool)p_obj;
+        case LuaObject::INTEGER:
+            return (int64_t)p_obj;
+        case LuaObject::NUMBER:
+            return (double)(lua_Number)p_obj;
+        case LuaObject::STRING: {
+            LuaString s = p_obj;
+            return ::godot::String::utf8(s.s, s.l);
+        }
+        case LuaObject::BUFFER:
+            return ((const LuaBuffer&)(p_obj.is_stack() ? p_obj.clone() : p_obj)).to_packed_byte_array();
+        case LuaObject::TABLE: {
+            if (p_obj.is_stack()) {
+                r_visited.copies.push_back(p_obj.clone());
+                return table_to_variant((const LuaTable&)r_visited.copies[r_visited.copies.size() - 1], p_depth, r_visited);
+            }
+            return table_to_variant((const LuaTable&)p_obj, p_depth, r_visited);
+        }
+        default:
+            ERR_FAIL_V_MSG(::godot::Variant(), ::godot::String("Cannot convert a Lua ") + p_obj.get_typename() + " to a Variant.");
+    }
+}
+
+LuaObject LuaObject::from_variant(const ::godot::Variant& p_var) {
+    return variant_to_lua(p_var, 0);
+}
+
+::godot::Variant LuaObject::to_variant() const {
+    VariantVisited visited;
+    return lua_to_variant(*this, 0, visited);
+}
+
+LuaTable LuaTable::from_packed_float32_array(const ::godot::PackedFloat32Array& p_array) {
+    return packed_to_table<lua_Number>(p_array);
+}
+
+::godot::PackedFloat32Array LuaTable::to_packed_float32_array() const {
+    ::godot::PackedFloat32Array array;
+    const size_t n = arr_len();
+    array.resize(n);
+    float *dst = array.ptrw();
+    for (size_t i = 0; i < n; i++)
+        dst[i] = (float)(lua_Number)get(LuaObject((lua_Integer)(i + 1)));
+    return array;
+}
+
+LuaTable LuaTable::from_dictionary(const ::godot::Dictionary& p_dict) {
+    return dictionary_to_table(p_dict, 0);
+}
+
+::godot::Dictionary LuaTable::to_dictionary() const {
+    ::godot::Dictionary dict;
+    VariantVisited visited;
+    visited.tables.insert(this, ::godot::Variant());
+    foreach([&dict, &visited](const LuaObject& k, const LuaObject& v) {
+        dict[lua_to_variant(k, 1, visited)] = lua_to_variant(v, 1, visited);
+    });
+    return dict;
+}
+
+} // namespace gdrblx
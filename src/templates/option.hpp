@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <godot_cpp/core/error_macros.hpp>
 
+#include <type_traits>
 #include <utility>
 
 namespace gdrblx {
@@ -17,8 +18,8 @@ class Option {
 public:
     constexpr Option() : exists(true), object() {}
     constexpr Option(std::nullptr_t) : exists(false) {}
-    template <typename... Args>
-    constexpr Option(Args... p_args) : exists(true), object(p_args...) {}
+    template <typename... Args> requires (!(sizeof...(Args) == 1 && (std::is_same_v<std::remove_cvref_t<Args>, Option> && ...)))
+    constexpr Option(Args&&... p_args) : exists(true), object(std::forward<Args>(p_args)...) {}
     
     constexpr Option(const Option& p_other) : exists(p_other.exists) {
         if (p_other.exists)
@@ -48,13 +49,15 @@ public:
     }
 
     Option& operator=(const Option& p_other) {
+        if (this == &p_other)
+            return *this;
         this->~Option();
         new (this) Option(p_other);
         return *this;
     }
     Option& operator=(T&& p_other) {
         this->~Option();
-        new (this) Option(p_other);
+        new (this) Option(std::move(p_other));
         return *this;
     }
     Option& operator=(const T& p_other) {
@@ -63,8 +66,10 @@ public:
         return *this;
     }
     Option& operator=(Option&& p_other) {
+        if (this == &p_other)
+            return *this;
         this->~Option();
-        new (this) Option(p_other);
+        new (this) Option(std::move(p_other));
         return *this;
     }
 
@@ -3,11 +3,14 @@
 
 #include <cstddef>
 #include <type_traits>
+#include <utility>
 
 #include <godot_cpp/core/memory.hpp>
 #include <godot_cpp/classes/rw_lock.hpp>
 #include <godot_cpp/classes/mutex.hpp>
 
+#include "option.hpp"
+
 namespace gdrblx {
 
 namespace internal {
@@ -17,11 +20,14 @@ concept RcCanCastBetween = requires(A* ptr) {(B*)ptr;};
 
 class KnowsRcSelf;
 class KnowsArcSelf;
+class LuaObject;
 
 template <typename T>
 class Rc;
 template <typename T>
 class Arc;
+template <typename T>
+class WeakArc;
 
 namespace internal {
 
@@ -47,19 +53,43 @@ private:
 template <typename T>
 class ArcHeader {
     friend class ::gdrblx::KnowsArcSelf;
+    friend class ::gdrblx::LuaObject;
     friend class ::gdrblx::Arc<T>;
+    friend class ::gdrblx::WeakArc<T>;
     friend class ReadGuard<T>;
     friend class WriteGuard<T>;
 public:
     ArcHeader() : object((T*)((size_t)this+sizeof(ArcHeader<T>))) {}
-    virtual ~ArcHeader() {
-        object->~T();
-    }
+    virtual ~ArcHeader() {}
 private:
+    // The strong references together hold one weak reference, so the header
+    // outlives the object for as long as a WeakArc still points at it.
     mutable size_t ref_count = 1;
+    mutable size_t weak_count = 1;
     ::godot::RWLock rwlock;
     mutable ::godot::Mutex mtx;
     T *const object;
+
+    virtual void destroy_object() const {
+        object->~T();
+    }
+    void release() const {
+        mtx.lock();
+        if (--ref_count > 0) {
+            mtx.unlock();
+            return;
+        }
+        mtx.unlock();
+        destroy_object();
+        release_weak();
+    }
+    void release_weak() const {
+        mtx.lock();
+        const bool last = --weak_count == 0;
+        mtx.unlock();
+        if (last)
+            ::godot::memdelete(const_cast<ArcHeader<T>*>(this));
+    }
 };
 
 template <typename T>
@@ -76,12 +106,7 @@ class ReadGuard {
 public:
     ~ReadGuard() {
         header->rwlock.read_unlock();
-        header->mtx.lock();
-        if (--header->ref_count == 0) {
-            header->mtx.unlock();
-            ::godot::memdelete(header);
-        }
-        header->mtx.unlock();
+        header->release();
     }
     const T* operator->() const {
         return (const T*)(((size_t)header->object)+offset);
@@ -107,12 +132,7 @@ class WriteGuard {
 public:
     ~WriteGuard() {
         header->rwlock.write_unlock();
-        header->mtx.lock();
-        if (--header->ref_count == 0) {
-            header->mtx.unlock();
-            ::godot::memdelete(header);
-        }
-        header->mtx.unlock();
+        header->release();
     }
     T* operator->() const {
         return (T*)(((size_t)header->object)+offset);
@@ -197,6 +217,9 @@ public:
 
 template <typename T>
 class Arc {
+    friend class LuaObject;
+    template <typename>
+    friend class WeakArc;
     internal::ArcHeader<T> *const header;
     size_t offset = 0;
     Arc(internal::ArcHeader<T> *p_header, size_t p_offset) : header(p_header), offset(p_offset) {}
@@ -220,12 +243,7 @@ public:
         header->mtx.unlock();
     }
     ~Arc() {
-        header->mtx.lock();
-        if (--header->ref_count == 0) {
-            header->mtx.unlock();
-            ::godot::memdelete(header);
-        }
-        header->mtx.unlock();
+        header->release();
     }
     internal::WriteGuard<T> operator->() {
         return internal::WriteGuard<T>(header, offset);
@@ -303,11 +321,19 @@ protected:
     template <class T>
     Arc<T> get_arc(const T* p_this) const {
         const size_t offset = ((size_t)p_this - (size_t)header_ptr->object);
+        header_ptr->mtx.lock();
+        header_ptr->ref_count++;
+        header_ptr->mtx.unlock();
         return Arc<T>((internal::ArcHeader<T>*)(void*)header_ptr, offset);
     }
+    template <class T>
+    WeakArc<T> get_weak_arc(const T* p_this) const {
+        return WeakArc<T>(get_arc(p_this));
+    }
 };
 
-template <typename T> requires internal::RcCanCastBetween<T, KnowsRcSelf>
+// RcCanCastBetween accepts any pointer through (B*), so check for the base class itself.
+template <typename T> requires std::is_base_of_v<KnowsRcSelf, T>
 class Rc<T> {
     friend class KnowsRcSelf;
     internal::RcHeader<T> *header;
@@ -376,9 +402,12 @@ public:
     }
 };
 
-template <typename T> requires internal::RcCanCastBetween<T, KnowsArcSelf>
+template <typename T> requires std::is_base_of_v<KnowsArcSelf, T>
 class Arc<T> {
     friend class KnowsArcSelf;
+    friend class LuaObject;
+    template <typename>
+    friend class WeakArc;
     internal::ArcHeader<T> *const header;
     size_t offset = 0;
     Arc(internal::ArcHeader<T> *p_header, size_t p_offset) : header(p_header), offset(p_offset) {}
@@ -405,12 +434,7 @@ public:
         header->mtx.unlock();
     }
     ~Arc() {
-        header->mtx.lock();
-        if (--header->ref_count == 0) {
-            header->mtx.unlock();
-            ::godot::memdelete(header);
-        }
-        header->mtx.unlock();
+        header->release();
     }
     internal::WriteGuard<T> operator->() {
         return internal::WriteGuard<T>(header, offset);
@@ -469,5 +493,86 @@ public:
     }
 };
 
+// Non owning reference to an Arc, for back references (a child's parent, a connection's signal)
+// that would otherwise keep a cycle alive. upgrade() returns nullptr once the object is destroyed.
+template <typename T>
+class WeakArc {
+    template <typename>
+    friend class WeakArc;
+    internal::ArcHeader<T> *header = nullptr;
+    size_t offset = 0;
+    void acquire() const {
+        if (header == nullptr)
+            return;
+        header->mtx.lock();
+        header->weak_count++;
+        header->mtx.unlock();
+    }
+public:
+    WeakArc() {}
+    WeakArc(std::nullptr_t) {}
+    WeakArc(const Arc<T>& p_arc) : header(p_arc.header), offset(p_arc.offset) {
+        acquire();
+    }
+    template <typename DT> requires internal::RcCanCastBetween<DT, T>
+    WeakArc(const Arc<DT>& p_arc) : header((internal::ArcHeader<T>*)(void*)p_arc.header), offset(((size_t)(T*)&p_arc.unsafe_access()) - ((size_t)p_arc.header->object)) {
+        acquire();
+    }
+    WeakArc(const WeakArc<T>& p_other) : header(p_other.header), offset(p_other.offset) {
+        acquire();
+    }
+    WeakArc(WeakArc<T>&& p_other) : header(p_other.header), offset(p_other.offset) {
+        p_other.header = nullptr;
+    }
+    ~WeakArc() {
+        if (header != nullptr)
+            header->release_weak();
+    }
+
+    Option<Arc<T>> upgrade() const {
+        if (header == nullptr)
+            return nullptr;
+        header->mtx.lock();
+        if (header->ref_count == 0) {
+            header->mtx.unlock();
+            return nullptr;
+        }
+        header->ref_count++;
+        header->mtx.unlock();
+        return Arc<T>(header, offset);
+    }
+    bool expired() const {
+        if (header == nullptr)
+            return true;
+        header->mtx.lock();
+        const bool dead = header->ref_count == 0;
+        header->mtx.unlock();
+        return dead;
+    }
+
+    WeakArc<T>& operator=(const WeakArc<T>& p_other) {
+        if (this == &p_other)
+            return *this;
+        this->~WeakArc();
+        new (this) WeakArc(p_other);
+        return *this;
+    }
+    WeakArc<T>& operator=(WeakArc<T>&& p_other) {
+        if (this == &p_other)
+            return *this;
+        this->~WeakArc();
+        new (this) WeakArc(std::move(p_other));
+        return *this;
+    }
+
+    // Identity only, the objects may already be gone.
+    bool operator==(const WeakArc<T>& p_other) const {
+        return header == p_other.header && offset == p_other.offset;
+    }
+    bool operator!=(const WeakArc<T>& p_other) const {
+        return !(*this == p_other);
+    }
+};
+
 } // namespace gdrblx
 #endif
\ No newline at end of file
@@ -8,16 +8,17 @@ namespace gdrblx {
 
 template <typename T = void, typename... Args>
 class Tuple {
-    const T o;
-    const Tuple<Args...> p_next;
+    T o;
+    Tuple<Args...> p_next;
 public:
     static constexpr size_t size = 1+sizeof...(Args);
 
     constexpr Tuple(const Tuple<T, Args...>& p_other) : o(p_other.o), p_next(p_other.p_next) {}
+    constexpr Tuple(Tuple<T, Args...>&& p_other) : o(std::move(p_other.o)), p_next(std::move(p_other.p_next)) {}
 
     constexpr Tuple() : o() {}
-    constexpr Tuple(T p_o) : o(p_o) {}
-    constexpr Tuple(T p_o, Args... p_args) : o(p_o), p_next(p_args...) {}
+    constexpr Tuple(T p_o) : o(std::move(p_o)) {}
+    constexpr Tuple(T p_o, Args... p_args) : o(std::move(p_o)), p_next(std::move(p_args)...) {}
 
     template <size_t idx, typename RetT>
     constexpr RetT& get() & {
@@ -52,8 +53,13 @@ public:
     }
 
     constexpr Tuple<T, Args...>& operator=(const Tuple<T, Args...>& p_other) {
-        this->~Tuple();
-        new (this) Tuple(p_other);
+        o = p_other.o;
+        p_next = p_other.p_next;
+        return *this;
+    }
+    constexpr Tuple<T, Args...>& operator=(Tuple<T, Args...>&& p_other) {
+        o = std::move(p_other.o);
+        p_next = std::move(p_other.p_next);
         return *this;
     }
 };
@@ -79,14 +85,15 @@ public:
 
 template <typename T>
 class Tuple<T> {
-    const T o;
+    T o;
 public:
     static constexpr size_t size = 1;
 
     constexpr Tuple(const Tuple<T>& p_other) : o(p_other.o) {}
+    constexpr Tuple(Tuple<T>&& p_other) : o(std::move(p_other.o)) {}
 
     constexpr Tuple() : o() {}
-    constexpr Tuple(T p_o) : o(p_o) {}
+    constexpr Tuple(T p_o) : o(std::move(p_o)) {}
 
     template <size_t idx>
     constexpr T&& get() && {
@@ -112,8 +119,11 @@ public:
     }
 
     constexpr Tuple<T>& operator=(const Tuple<T>& p_other) {
-        this->~Tuple();
-        new (this) Tuple(p_other);
+        o = p_other.o;
+        return *this;
+    }
+    constexpr Tuple<T>& operator=(Tuple<T>&& p_other) {
+        o = std::move(p_other.o);
         return *this;
     }
 };
@@ -8,8 +8,11 @@ int RBXScriptConnection::lua_Disconnect(lua_State *L) {
     auto conn = ctx.expect(1, UD_RBXSCRIPTCONNECTION).as_userdata<RBXScriptConnection>().write(); // RBXScriptConnection*
     if (conn->ref.is_type(LuaObject::NIL))
         return ctx.return_call(); // reference already removed.
-    auto signal = conn->sign.write(); // RBXScriptSignal*
-    signal->connected_functions.get(conn->ref.get_luau_state()).erase(Tuple<bool, LuaObject>(conn->desync,conn->ref)); // remove the connection
+    Option<Arc<RBXScriptSignal>> protected_signal = conn->sign.upgrade();
+    if (protected_signal.exists) { // a destroyed signal already dropped its connections.
+        auto signal = protected_signal.unwrap().write(); // RBXScriptSignal*
+        signal->connected_functions.get(conn->ref.get_luau_state()).erase(Tuple<bool, LuaObject>(conn->desync,conn->ref)); // remove the connection
+    }
     conn->ref = NIL_OBJECT_REF; // mark as disconnected.
     return ctx.return_call();
 }
@@ -25,7 +28,7 @@ Arc<RBXScriptConnection> RBXScriptSignal::_connect(LuauState &p_state, bool p_de
     Arc<RBXScriptConnection> protected_connection = RBXScriptConnection();
     RBXScriptConnection& connection = protected_connection.unsafe_access();
     connection.desync = p_desynchronized;
-    connection.sign = this->get_arc(this);
+    connection.sign = this->get_weak_arc(this);
     connection.ref = p_func;
     return protected_connection;
 }
@@ -61,18 +64,22 @@ int RBXScriptSignal::lua_Wait(lua_State *L) {
 
     ctx.expect_argn(1);
     Arc<RBXScriptSignal> protected_signal = ctx.expect(1, UD_RBXSCRIPTSIGNAL).as_userdata<RBXScriptSignal>();
-    auto signal = protected_signal.write(); // RBXScriptSignal*
-    LuaObject func = LuaObject(ctx.create_lambda((lua_CFunction)[](lua_State *inner_L){
-        LuauFnCtx inner_ctx = inner_L;
-        inner_ctx.get_upvalue(2).rawget("Disconnect").method_call(inner_ctx);
-        ((LuauState&)inner_ctx.state).get_scheduler()->spawn((LuaThread)inner_ctx.get_upvalue(1), inner_ctx.get_args());
-        return inner_ctx.return_call();
-    }, L, NIL_OBJECT_REF)).clone_in(&state);
-
-    LuaFunction(func).set_upvalue(2, signal->_connect(state, desynchronized, func));
+    protected_signal.read()->add_waiting_thread(&state, desynchronized, (LuaThread)ctx);
     return ctx.yield();
 }
 
+HashMap<LuauState*, LocalVec<Tuple<bool, LuaThread>>> RBXScriptSignal::take_waiting_threads() const {
+    std::lock_guard guard(waiting_lock);
+    HashMap<LuauState*, LocalVec<Tuple<bool, LuaThread>>> waiting = waiting_threads;
+    waiting_threads.clear();
+    return waiting;
+}
+
+void RBXScriptSignal::add_waiting_thread(LuauState *p_state, bool p_desynchronized, const LuaThread& p_thread) const {
+    std::lock_guard guard(waiting_lock);
+    waiting_threads[p_state].push_back(Tuple<bool, LuaThread>(p_desynchronized, p_thread));
+}
+
 int RBXScriptSignal::lua_Once(lua_State *L) {
     LuauFnCtx ctx = L;
     LuauState& state = ctx.state;
@@ -94,20 +101,45 @@ int RBXScriptSignal::lua_Once(lua_State *L) {
     return ctx.return_call(connection);
 }
 
+// The arguments as seen by p_state: immutable ones are shared, the rest copied once per state.
+static LuaTuple share_args(const LuaTuple& p_args, LuauState *p_state) {
+    Vec<LuaObject> args;
+    args.resize(p_args.get_size());
+    for (size_t i = 0; i < p_args.get_size(); i++)
+        args.set(i, p_args[i + 1].share_in(p_state));
+    return LuaTuple(std::move(args));
+}
+
 void RBXScriptSignal::Fire(LuaTuple p_args) const {
+    for (auto it : take_waiting_threads()) {
+        LuauState *state = it.key;
+        const LuaTuple args = share_args(p_args, state);
+        for (const Tuple<bool, LuaThread>& thr : it.value) {
+            state->get_scheduler()->defer(thr.get<0, bool>(), thr.get<1, LuaThread>(), args);
+        }
+    }
     for (auto it : connected_functions) {
         LuauState *state = it.key;
+        const LuaTuple args = share_args(p_args, state);
         for (const Tuple<bool, LuaObject>& func : it.value) {
-            state->get_scheduler()->defer(func.get<0, bool>(), LuaFunction(func.get<1, LuaObject>()), p_args);
+            state->get_scheduler()->defer(func.get<0, bool>(), LuaFunction(func.get<1, LuaObject>()), args);
         }
     }
 }
 
 void RBXScriptSignal::FireNow(LuaTuple p_args) const {
+    for (auto it : take_waiting_threads()) {
+        LuauState *state = it.key;
+        const LuaTuple args = share_args(p_args, state);
+        for (const Tuple<bool, LuaThread>& thr : it.value) {
+            state->get_scheduler()->spawn(thr.get<0, bool>(), thr.get<1, LuaThread>(), args);
+        }
+    }
     for (auto it : connected_functions) {
         LuauState *state = it.key;
+        const LuaTuple args = share_args(p_args, state);
         for (const Tuple<bool, LuaObject>& func : it.value) {
-            state->get_scheduler()->spawn(func.get<0, bool>(), LuaFunction(func.get<1, LuaObject>()), p_args);
+            state->get_scheduler()->spawn(func.get<0, bool>(), LuaFunction(func.get<1, LuaObject>()), args);
         }
     }
 }
@@ -1,6 +1,8 @@
 #ifndef EVENTS_HPP
 #define EVENTS_HPP
 
+#include <mutex>
+
 #include <godot_cpp/templates/hash_map.hpp>
 #include <godot_cpp/templates/vector.hpp>
 
@@ -10,6 +12,7 @@
 #include <core/context.hpp>
 #include <core/function.hpp>
 #include <core/userdata.hpp>
+#include <core/native_coroutine.hpp>
 
 namespace gdrblx {
 
@@ -19,7 +22,7 @@ class RBXScriptConnection final : private LuaUserdataIndex, private LuaUserdataT
     friend class RBXScriptSignal;
     LuaObject ref;
     bool desync = false;
-    Arc<RBXScriptSignal> sign;
+    WeakArc<RBXScriptSignal> sign; // the signal owns its connections, not the other way around.
     static int lua_Disconnect(lua_State *L);
     virtual LuaObject lua_get(lua_State *L, LuaObject p_key) const override {
         if (!p_key.is_type(LuaObject::STRING)) {
@@ -42,8 +45,13 @@ class RBXScriptConnection final : private LuaUserdataIndex, private LuaUserdataT
 class RBXScriptSignal final : private LuaUserdataIndex, private LuaUserdataToString, private KnowsArcSelf {
     friend class RBXScriptConnection;
     HashMap<LuauState*, LocalVec<Tuple<bool, LuaObject>>> connected_functions;
+    // Threads suspended in Wait, resumed once by the next Fire without a connection.
+    mutable HashMap<LuauState*, LocalVec<Tuple<bool, LuaThread>>> waiting_threads;
+    mutable std::mutex waiting_lock;
 
     Arc<RBXScriptConnection> _connect(LuauState &p_state, bool p_desynchronized, const LuaObject& p_func);
+    // Empties the list under the lock, resumed threads may Wait again before the Fire returns.
+    HashMap<LuauState*, LocalVec<Tuple<bool, LuaThread>>> take_waiting_threads() const;
 
     static int lua_Connect(lua_State *L);
     static int lua_ConnectParallel(lua_State *L);
@@ -71,6 +79,8 @@ public:
     operator LuaString() const override {
         return "RBXScriptSignal";
     }
+    void add_waiting_thread(LuauState *p_state, bool p_desynchronized, const LuaThread& p_thread) const;
+
     void Fire(LuaTuple p_args) const;
     template <typename... Args>
     GDRBLX_INLINE void Fire(Args... p_args) const {Fire(LuaTuple(p_args...));}
@@ -89,6 +99,33 @@ public:
     }
 };
 
+namespace internal {
+
+// `co_await signal` from a LuaNativeTask, resumes with the arguments passed to Fire.
+class LuaSignalAwaiter final {
+    Arc<RBXScriptSignal> signal;
+    LuaNativeTask::Handle handle;
+public:
+    GDRBLX_INLINE LuaSignalAwaiter(const Arc<RBXScriptSignal>& p_signal) : signal(p_signal) {}
+
+    GDRBLX_INLINE bool await_ready() const { return false; }
+    GDRBLX_INLINE void await_suspend(LuaNativeTask::Handle p_handle) {
+        handle = p_handle;
+        LuauCtx ctx = p_handle.promise().L;
+        LuauState& state = ctx.state;
+        signal.read()->add_waiting_thread(&state, !state.synchronized(), (LuaThread)ctx);
+    }
+    GDRBLX_INLINE LuaStackView await_resume() const {
+        return handle.promise().get_resume_args();
+    }
+};
+
+} // namespace internal
+
+inline internal::LuaSignalAwaiter operator co_await(const Arc<RBXScriptSignal>& p_signal) {
+    return internal::LuaSignalAwaiter(p_signal);
+}
+
 USERDATA_INITIALIZER(RBXScriptConnection, UD_RBXSCRIPTCONNECTION);
 USERDATA_INITIALIZER(RBXScriptSignal, UD_RBXSCRIPTSIGNAL);
 
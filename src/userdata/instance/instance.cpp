@@ -1 +1,54 @@
-#include "instance.hpp"
\ No newline at end of file
+#include "instance.hpp"
+
+#include <vm.hpp>
+#include <core/context.hpp>
+
+namespace gdrblx {
+
+void Instance::lua_init(LuauState* p_state) {
+    LuaStringPool& pool = p_state->get_vm()->get_string_pool();
+    pool.pin_string(class_name());
+    methods.pin_names(pool);
+}
+
+void Instance::set_name(const LuauCtx& p_ctx, const LuaString& p_name) {
+    Name = ((RobloxVM&)p_ctx.vm).intern(p_name);
+}
+
+void Instance::set_attribute(const LuauCtx& p_ctx, const LuaString& p_key, const LuaObject& p_value) {
+    const LuaString key = ((RobloxVM&)p_ctx.vm).intern(p_key);
+    if (p_value.is_type(LuaObject::NIL))
+        attributes.erase(key);
+    else
+        attributes[key] = p_value;
+}
+
+bool Instance::_instance_mro_set(LuauFnCtx& p_ctx, LuaObject p_key, LuaObject p_value) {
+    if (p_key == "Name") {
+        if (!p_value.is_type(LuaObject::STRING))
+            p_ctx.errorf("expected Name to be a string, got %s", p_value.get_typename());
+        const LuaString name = p_value;
+        set_name(p_ctx, name);
+        INSTANCE_SIGNAL_EMIT(this, Changed, LuaObject("Name"));
+        if (const Arc<RBXScriptSignal> *signal = property_changed.getptr(LuaString("Name")))
+            signal->read()->Fire();
+        return true;
+    }
+    return false;
+}
+
+int Instance::SetAttribute(lua_State *L) {
+    LuauFnCtx ctx = L;
+    ctx.expect_argn(2, 3);
+    Arc<Instance> instance = ctx.expect(1, UD_INSTANCE).as_userdata<Instance>();
+    const LuaString key = ctx.expect(2, LuaObject::STRING);
+    const LuaObject value = ctx.get_arg(3);
+    instance.write()->set_attribute(ctx, key, value); // nothing raises while the guard is held.
+    auto self = instance.read(); // const Instance*
+    INSTANCE_SIGNAL_EMIT(self, AttributeChanged, LuaObject(key));
+    if (const Arc<RBXScriptSignal> *signal = self->attribute_changed.getptr(key))
+        signal->read()->Fire();
+    return ctx.return_call();
+}
+
+} // namespace gdrblx
@@ -32,17 +32,21 @@ class Instance : private LuaUserdataIndex, private LuaUserdataSetIndex, private
         return UD_INSTANCE;
     }
 protected:
+    GDRBLX_INLINE static const LuaString& class_name() {
+        static const LuaString name = "Instance";
+        return name;
+    }
     virtual LuaString get_class_name() const {
-        return "Instance";
+        return class_name();
     }
 private:
     static constexpr uint64_t INVALID_UNIQUEID = 0;
     uint64_t uniqueid = INVALID_UNIQUEID;
 
     Vec<Arc<Instance>> children;
-    Option<Arc<Instance>> parent = nullptr;
+    WeakArc<Instance> parent; // back reference, the parent owns its children.
 
-    GDRBLX_INLINE Option<Arc<Instance>> get_parent() const { return parent; }
+    GDRBLX_INLINE Option<Arc<Instance>> get_parent() const { return parent.upgrade(); }
     void set_parent(Option<Arc<Instance>> p_other, bool force = false);
 
     bool parent_locked = false;
@@ -140,12 +144,21 @@ protected:
     virtual bool instance_mro_isa(LuaString p_str) const;
     virtual void instance_mro_destroy_hook() {}
 
+    // Names and attribute keys are compared all the time, they are stored interned in the VM's pool.
+    // Change signals are left to the callers, __newindex for Name and SetAttribute.
+    void set_name(const LuauCtx& p_ctx, const LuaString& p_name);
+    void set_attribute(const LuauCtx& p_ctx, const LuaString& p_key, const LuaObject& p_value);
+
     bool _instance_mro_get(LuauFnCtx& p_ctx, LuaObject p_key) const;
     bool _instance_mro_set(LuauFnCtx& p_ctx, LuaObject p_key, LuaObject p_value);
     void _instance_mro_clone(LuauFnCtx& p_ctx, Arc<Instance> p_instance, Instance* p_ptr) const;
     bool _instance_mro_isa(LuaString p_str) const;
 
 public:
+    // ModuleScript overrides this, returns the function require() should run.
+    virtual Option<LuaFunction> get_module_function(const LuauCtx& p_ctx) const { return nullptr; }
+
+    // Pins the class and method names in the VM's pool, so names and keys interned later share them.
     static void lua_init(LuauState* p_state);
 };
 
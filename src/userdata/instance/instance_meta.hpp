@@ -3,6 +3,7 @@
 
 #include <core/state.hpp>
 #include <core/function.hpp>
+#include <core/string_pool.hpp>
 #include <templates/option.hpp>
 
 #include <type_traits>
@@ -44,17 +45,22 @@ class InstanceMethods {
     HashMap<LuaString, LuaFunction, LuaStringHasher> methods;
 public:
     InstanceMethods& register_method(const char* p_name, lua_CFunction p_method) {
-        methods[p_name] = LuaFunction(p_method, p_name);
+        methods[LuaString(p_name)] = LuaFunction(p_method, LuaString(p_name));
         return *this;
     }
     InstanceMethods& register_method(const char* p_name, lua_CFunction p_method, lua_Continuation p_cont) {
-        methods[p_name] = LuaFunction(p_method, p_name, p_cont);
+        methods[LuaString(p_name)] = LuaFunction(p_method, LuaString(p_name), p_cont);
         return *this;
     }
     InstanceMethods& register_method(const char* p_name, const LuaFunction& p_method) {
-        methods[p_name] = p_method;
+        methods[LuaString(p_name)] = p_method;
         return *this;
     }
+    // From lua_init, with the VM of the state at hand.
+    void pin_names(LuaStringPool& p_pool) const {
+        for (const auto& kv : methods)
+            p_pool.pin_string(kv.key);
+    }
     Option<LuaFunction> get(LuaString p_name) {
         auto it = methods.find(p_name);
         if (it != methods.end()) 
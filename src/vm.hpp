@@ -6,6 +6,8 @@
 #include "core/object.hpp"
 #include "templates/rc.hpp"
 #include "core/state.hpp"
+#include "core/module_cache.hpp"
+#include "core/string_pool.hpp"
 
 namespace gdrblx {
 
@@ -26,9 +28,16 @@ public:
 
     Vec<Arc<Actor>> actors;
 
+    ModuleCache modules;
+    mutable LuaStringPool strings;
+
     RobloxVM();
     ~RobloxVM();
 
+    // Identifiers (names, class names, attribute keys) should go through here so equal ones share storage.
+    GDRBLX_INLINE LuaString intern(const LuaString& p_str) const { return strings.intern_string(p_str); }
+    GDRBLX_INLINE LuaStringPool& get_string_pool() const { return strings; }
+
     void log(LuaString str);
     void log_warn(LuaString str);
     void log_info(LuaString str);